@@ -27,6 +27,11 @@
 #include "maps/input_reader/maps_input_reader.hpp"
 #include "maps_OpenCV_Conversion.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
 // Declares a new MAPSComponent child class
 class MAPSOpenCV_Calibration
 : public  MAPSComponent
@@ -37,12 +42,59 @@ class MAPSOpenCV_Calibration
         OperationMode_LoadUndistort      = 1
     };
 
+    // Read-only memory mapping of a whole file
+    struct MappedFile
+    {
+        MappedFile();
+        ~MappedFile();
+        bool Open(const char* path);
+        void Close();
+
+        const unsigned char* data;
+        size_t size;
+#ifdef _WIN32
+        void* fileHandle;
+        void* mappingHandle;
+#endif
+    };
+
+    // Snapshot waiting for the chessboard detection
+    struct DetectionJob
+    {
+        MAPSTimestamp ts;
+        MAPSUInt32 channelSeq;
+        cv::Mat image;
+        cv::Mat rightImage; // stereo only
+    };
+
+    // Collected snapshot waiting to be written on disk
+    struct PendingSave
+    {
+        int index;
+        const char* prefix; // "left_"/"right_" in stereo
+        cv::Mat original;
+        cv::Mat withCorners;
+    };
+
     enum CaptureMode
     {
         CaptureMode_Periodic  = 0,
         CaptureMode_Triggered = 1
     };
 
+    enum CameraModel
+    {
+        CameraModel_Pinhole = 0,
+        CameraModel_Fisheye = 1
+    };
+
+    enum PointsInput
+    {
+        PointsInput_None      = 0,
+        PointsInput_Integer32 = 1,
+        PointsInput_Float32   = 2
+    };
+
     // Use standard header definition macro
     MAPS_COMPONENT_STANDARD_HEADER_CODE(MAPSOpenCV_Calibration)
     MAPS_COMPONENT_DYNAMIC_HEADER_CODE(MAPSOpenCV_Calibration)
@@ -74,7 +126,31 @@ private:
     MAPSString m_folderPath;
     MAPSString m_filePath;
     int m_undistMode;
+    int m_cameraModel;
+    bool m_stereo;
     double m_alpha;
+    bool m_useRemapCache;
+    MappedFile m_remapCacheFile;
+
+    // Loading mode inputs: images, points (x,y vectors) and drawing objects, each one being optional
+    bool m_useImageInput;
+    int m_pointsInput;
+    int m_maxPoints;
+    bool m_useObjectsInput;
+    int m_maxObjects;
+    std::vector<MAPSInput*> m_inputs;
+    int m_imageInputIndex;
+    int m_pointsInputIndex;
+    int m_objectsInputIndex;
+    MAPSOutput* m_pointsOutput;
+    MAPSOutput* m_objectsOutput;
+    bool m_imageBuffersAllocated;
+
+    cv::Size m_calibrationImageSize; // image size stored in the calibration file, used for the points when no image has been received
+    cv::Mat m_pointsNewMatrix;
+    cv::Size m_pointsNewMatrixSize;
+    std::vector<cv::Point2f> m_distortedPoints;
+    std::vector<cv::Point2f> m_undistortedPoints;
 
     cv::Size m_boardSz;
     cv::Size m_imageSize;
@@ -83,26 +159,82 @@ private:
     cv::Mat m_distortionCoeffs;
     double  m_reprojectionError;
 
+    cv::Mat m_undistMap1; // fixed-point undistortion maps (CV_16SC2 + CV_16UC1), computed once per calibration
+    cv::Mat m_undistMap2;
+
     std::vector<cv::Mat> m_extrinsicMatrices;
     std::vector<cv::Mat> m_rvecs;
     std::vector<cv::Mat> m_tvecs;
 
+    // Stereo: the members above describe the left camera
+    cv::Mat m_intrinsicMatrixRight;
+    cv::Mat m_distortionCoeffsRight;
+    cv::Mat m_stereoRotation;
+    cv::Mat m_stereoTranslation;
+    cv::Mat m_essentialMatrix;
+    cv::Mat m_fundamentalMatrix;
+    cv::Mat m_rectificationLeft;
+    cv::Mat m_rectificationRight;
+    cv::Mat m_projectionLeft;
+    cv::Mat m_projectionRight;
+    cv::Mat m_disparityToDepth;
+    cv::Mat m_rightMap1;
+    cv::Mat m_rightMap2;
+    MAPSOutput* m_rightImageOutput;
+    MAPSOutput* m_disparityToDepthOutput;
+    MAPSTimestamp m_lastCaptureTs;
+    std::vector<std::vector<cv::Point2f> > m_imagePointsRight;
+
     std::vector<cv::Point3f> m_realGrid;
 
     std::vector<std::vector<cv::Point2f> > m_imagePoints;
     std::vector<std::vector<cv::Point3f> > m_objectPoints;
 
-    void Core_Calibrate_Actual(MAPSTimestamp ts, const IplImage& imageIn);
+    // Background chessboard detection and images saving, during the collection
+    std::mutex m_collectMutex;
+    std::condition_variable m_collectCond;
+    bool m_stopCollecting;
+    std::string m_collectError;
+    std::deque<DetectionJob> m_detectionJobs;
+    std::deque<PendingSave> m_pendingSaves;
+    std::thread m_detectionThread;
+    std::thread m_savingThread;
+
+    void Core_Calibrate_Actual(MAPSTimestamp ts, const IplImage& imageIn, const IplImage* rightImageIn = nullptr);
     void UpdateOperationModeProperty();
+    void UpdateStereoProperty();
     void UpdateCaptureModeProperty();
+    void CreateStereoInputsOutputs();
+    std::unique_ptr<MAPS::InputReader> MakeStereoInputReader();
     void ComputeRealGrid();
     void AllocateBuffers(const IplImage& iplImageIn);
+    void StartCollection();
+    void StopCollection();
+    void SetCollectError(const MAPSString& message);
     bool DetectPattern(cv::Mat& grayImage, std::vector<cv::Point2f>& detectedCorners);
-    void CollectImage(MAPSTimestamp ts, const IplImage& iplImageIn);
-    void SaveCollectedImage(cv::Mat& original, cv::Mat& withCorners);
+    void CollectImage(MAPSTimestamp ts, const IplImage& iplImageIn, const IplImage* rightIplImageIn);
+    bool DetectBoard(const cv::Mat& image, MAPSUInt32 channelSeq, std::vector<cv::Point2f>& detectedCorners);
+    void DrawBoard(MAPSOutput& output, MAPSTimestamp ts, const cv::Mat& image, const std::vector<cv::Point2f>& corners, cv::Mat& withCorners);
+    void DetectionThread();
+    void SavingThread();
+    void SaveCollectedImage(int index, const char* prefix, const cv::Mat& original, const cv::Mat& withCorners);
     void CalibrateCamera();
+    void CalibrateStereo();
     void SaveCalibration();
     void LoadCalibration();
+    cv::Mat ComputeNewCameraMatrix(const cv::Size& imageSize) const;
+    void UpdateUndistortMaps(bool tryRemapCache);
+    void ComputeUndistortMaps();
+    void ComputeRectificationMaps();
+    void RectifyPair(MAPSTimestamp ts, const IplImage& leftIplImage, const IplImage& rightIplImage);
+    void WriteDisparityToDepth(MAPSTimestamp ts);
+    void UndistortPoints();
+    void ProcessPoints(MAPSTimestamp ts, const MAPS::InputElt<>& inElt);
+    void ProcessObjects(MAPSTimestamp ts, const MAPS::InputElt<>& inElt);
+    MAPSString GetRemapCachePath() const;
+    bool ReadCalibrationFileHash(uint64_t& hash) const;
+    bool LoadRemapCache();
+    void SaveRemapCache();
     void UndistortImage(MAPSTimestamp ts, const IplImage& iplImageIn);
     void WriteCalibrationData(MAPSTimestamp ts);
 
@@ -110,5 +242,7 @@ private:
     void ProcessData_Triggered(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<>> inElts);
     void AllocateOutputBufferSize_Periodic(const MAPSTimestamp /*ts*/, const MAPS::InputElt<IplImage> inElt);
     void ProcessData_Periodic(const MAPSTimestamp ts, const MAPS::InputElt<IplImage> inElt);
-    void ProcessData_Reactive(const MAPSTimestamp ts, const MAPS::InputElt<IplImage> inElt);
+    void AllocateOutputBufferSize_Stereo(const MAPSTimestamp /*ts*/, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    void ProcessData_Stereo(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    void ProcessData_Reactive(const MAPSTimestamp ts, const size_t inputThatAnswered, const MAPS::ArrayView<MAPS::InputElt<>> inElts);
 };
@@ -24,6 +24,9 @@
 
 namespace convTools
 {
+    // Returns the cv::Mat depth (CV_8U, CV_16U, CV_32F...) matching an IplImage depth (IPL_DEPTH_8U, IPL_DEPTH_16U, IPL_DEPTH_32F...)
+    int iplDepthToCvDepth(int iplDepth);
+
     // Copy the IplImage to create a cv::Mat object. Use copy only when needed.
     cv::Mat copyIplImage2Mat(const IplImage* image);
 
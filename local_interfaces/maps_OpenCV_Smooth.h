@@ -41,6 +41,8 @@ private:
     void ProcessData(const MAPSTimestamp ts, const size_t inputThatAnswered, const MAPS::ArrayView<MAPS::InputElt<>> inElts);
     void ProcessDataSync(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<>> inElts);
     void ProcessIplImage(const IplImage& imageIn, IplImage& imageOut);
+    void SmoothRegion(const cv::Mat& src, cv::Mat& dst);
+    void BilateralFilter(const cv::Mat& src, cv::Mat& dst);
     void ProcessRoi(const MAPS::InputElt<>& Elt);
 
 private :
@@ -58,6 +60,9 @@ private :
     int m_height;
     cv::Mat m_tempImageIn;
     cv::Mat m_tempImageOut;
+    cv::Mat m_bilateralColor; // bilateral filter buffers for 4 channels and 16 bits images
+    cv::Mat m_bilateralIn;
+    cv::Mat m_bilateralOut;
     int m_syncMode;
 
     std::unique_ptr<MAPS::InputReader> m_inputReader;
@@ -33,6 +33,34 @@ typedef struct SortingElt
 	int zorder;
 } SortingElt;
 
+// One input to draw onto the output image
+struct ComposeJob
+{
+    int index; // input index
+    cv::Mat src; // part of the input image to draw
+    cv::Rect dstRect; // where to draw it in the output image
+    int cvtCode; // cv::cvtColor code to the output format, -1 if none
+    bool hasAlpha; // blended onto the output
+    bool dirty; // the canvas does not hold the current frame of this input
+    int level; // inputs with the same level do not overlap and are drawn concurrently
+};
+
+// Where and how an input is drawn, computed once for a given input image size
+struct ResizePlan
+{
+    bool valid; // false when the input properties changed
+    cv::Size sizeIn;
+    MAPSUInt32 chanSeqIn; // input format the plan was computed for
+    int depthIn;
+    int cvtCode; // cv::cvtColor code to the output format, -1 if none
+    bool placed; // false when the input is out of the output image
+    cv::Rect srcRect; // part of the input image to draw
+    cv::Rect dstRect; // where to draw it in the output image
+    int decimation; // 2 or 4 for exact integer downscaling ratios, 0 otherwise
+    std::vector<ushort> rowSum; // decimation buffer
+    ResizePlan() : valid(false), chanSeqIn(0), depthIn(0), cvtCode(-1), placed(false), decimation(0) {}
+};
+
 // Declares a new MAPSComponent child class
 class MAPSOpenCV_VideoMuxer : public MAPSComponent
 {
@@ -47,12 +75,20 @@ private:
     void Initialization_Trigerred(const MAPSTimestamp /*ts*/, const MAPS::ArrayView <MAPS::InputElt<IplImage>> inElts);
     void ProcessData(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
     void ProcessData_Reactive(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    void ProcessData_Periodic(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    void ProcessData_Async(const MAPSTimestamp ts, const size_t inputThatAnswered, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    bool InitializeSizes(const MAPS::ArrayView<MAPS::InputElt<IplImage>>& inElts);
 
     void ComputeSizesAndAllocOutBuffer();
     void OutputResultImage(MAPSTimestamp t, const MAPS::ArrayView<MAPS::InputElt<IplImage>>& inElts);
+    bool ComputeInputPlacement(int i, int image_index, const cv::Size& sizeIn, cv::Rect& srcRect, cv::Rect& dstRect);
+    void ComposeInput(const ComposeJob& job, cv::Mat& dst);
+    void ResizeInput(const ComposeJob& job, const cv::Mat& src, cv::Mat& dst, cv::Size size);
+    void SetOutputFormat(const IplImage& imageIn);
+    void CheckInputFormat(const IplImage& imageIn, int inputIndex);
     void SortIOEltsByZOrder();
 
-    void BackgroundInitialization(IplImage* imageOut);
+    void ResetCanvas();
 
 private :
     // Place here your specific methods and attributes
@@ -62,11 +98,10 @@ private :
     int m_readersMode;
     bool m_allSizesInitialized;
     int m_trigger;
-    int m_totalmWidth; // output image width (before eventual resize)
+    int m_totalmWidth; // composed image width, in which the input positions are expressed
     int m_totalmHeight;
-    int m_outmWidth; // final output image width (after eventual resize)
+    int m_outmWidth; // final output image width (the composed image is scaled to it)
     int m_outmHeight;
-    bool m_outNeedResize;
     bool m_outputInitialized;
     unsigned int m_dataOrder;
     unsigned int m_depth;
@@ -81,15 +116,22 @@ private :
     std::vector<int> m_ioeltsOrder;
 
     std::vector<MAPSInput*> m_inputs;
-    std::vector<void*> m_bgInitialized;
+    std::vector<MAPSInt64> m_inputFrames; // per input, number of the current frame
+    std::vector<const void*> m_lastSampledData; // periodic mode: per input, image sampled at the previous period
+    std::vector<MAPSTimestamp> m_lastSampledTs;
 
     std::mutex m_zorderMutex;
     MAPSUInt32 m_chanSeq;
-    IplImage m_tempImage;
-    IplROI m_tempROI;
-    std::vector<char> m_tempImageData;
     MAPSArray<MAPSIOElt*> m_ioEltImage;
-    cv::Mat m_black;
+    cv::Mat m_canvas; // composed image, kept from one output to the next
+    bool m_canvasValid; // false when the layout changed: the canvas has to be cleared and fully redrawn
+    std::vector<MAPSInt64> m_drawnFrames; // per input, frame number last drawn in the canvas (-1: never)
+    std::vector<ResizePlan> m_resizePlans;
+    std::vector<ComposeJob> m_composeJobs;
+    std::vector<ComposeJob*> m_levelJobs;
+    std::vector<cv::Mat> m_resizedImages; // per input, intermediate resized image (blending, conversion)
+    std::vector<cv::Mat> m_convertedImages; // per input, intermediate converted image (blending, conversion)
+    int m_outColorFormat;
 
     std::unique_ptr<MAPS::InputReader> m_inputReader;
 };
@@ -27,6 +27,15 @@
 #include "maps/input_reader/maps_input_reader.hpp"
 #include "maps_OpenCV_Conversion.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <map>
+#include <memory>
+#include <opencv2/core/hal/intrin.hpp>
+
 #define NB_LABEL_COLORS 19
 static const int s_label_colors[NB_LABEL_COLORS][3] =
 {
@@ -51,19 +60,213 @@ static const int s_label_colors[NB_LABEL_COLORS][3] =
 {255,128,0}
 };
 
+// One detected object, in input image coordinates
+struct YoloDetection
+{
+    int classId;
+    float score;
+    cv::Rect box;
+    int trackId; // -1 when not tracked
+};
+
+// Object followed between the detections (detection_interval > 1)
+struct YoloTrack
+{
+    int id;
+    int classId;
+    float score;
+    cv::KalmanFilter kalman; // state: center x, center y, width, height and their velocities, in image pixels
+    cv::Rect2d box;
+    int misses; // successive detection rounds without a matching detection
+};
+
+// Propagates the detected boxes between the network runs: constant velocity Kalman prediction, corrected by
+// the sparse optical flow of a grid of points inside each box, and associated to the new detections by IoU.
+class YoloTracker
+{
+public:
+    YoloTracker();
+    void Reset();
+    // Moves the tracks from the previous to the current tracking image
+    void Track(const cv::Mat& prevGray, const cv::Mat& gray, double scale);
+    // Merges the detections computed on keyGray (an earlier image when the pipeline has some latency) into the tracks
+    void Update(const std::vector<YoloDetection>& detections, const cv::Mat& keyGray, const cv::Mat& gray, double scale);
+    void GetDetections(std::vector<YoloDetection>& detections) const;
+
+private:
+    void PropagateBoxes(const cv::Mat& prevGray, const cv::Mat& gray, double scale, std::vector<cv::Rect2d>& boxes, std::vector<uchar>& found);
+    static void CorrectTrack(YoloTrack& track, const cv::Rect2d& box, float noise);
+
+    std::vector<YoloTrack> m_tracks;
+    int m_nextId;
+    std::vector<cv::Point2f> m_points;
+    std::vector<cv::Point2f> m_nextPoints;
+    std::vector<uchar> m_status;
+    std::vector<float> m_err;
+    std::vector<cv::Rect2d> m_boxes;
+    std::vector<uchar> m_found;
+};
+
+// Maps network input coordinates to input image coordinates: x_image = x_net * scaleX + offsetX
+struct YoloBlobTransform
+{
+    double scaleX;
+    double scaleY;
+    double offsetX;
+    double offsetY;
+};
+
+// Outputs associated to one input (labels: nullptr when disabled)
+struct YoloInputOutputs
+{
+    MAPSOutput* boundingBoxes;
+    MAPSOutput* labels;
+    MAPSOutput* detections;
+};
+
+// Network loaded once per process for all the instances using the same model files, input size, backend and target
+struct YoloSharedModel
+{
+    cv::dnn::Net net;
+    std::vector<cv::String> outNames;
+    std::mutex forwardMutex; // cv::dnn::Net is not reentrant: one forward pass at a time
+    std::vector<int> warmedUpShape; // blob shape of the last warm-up forward pass, empty if none (under forwardMutex)
+};
+
+// Network input of one frame, filled by the component thread and consumed by the inference thread
+struct YoloBlobSlot
+{
+    bool repeat; // static scene: no blob, the previous detections are output again
+    cv::Mat blob; // one image per batch entry
+    std::vector<YoloBlobTransform> transforms; // per batch entry
+    std::vector<MAPSTimestamp> timestamps; // per input
+    std::vector<cv::Mat> keyGrays; // per input: tracking image (detection_interval > 1)
+    std::vector<cv::Rect> crops; // per input: motion region the network runs on (empty: whole image)
+};
+
+// Raw network outputs of one frame, filled by the inference thread and consumed by the decoding thread
+struct YoloOutputSlot
+{
+    bool repeat; // static scene: no outputs to decode, the previous detections are output again
+    std::vector<cv::Mat> outs;
+    std::vector<YoloBlobTransform> transforms; // per batch entry
+    std::vector<MAPSTimestamp> timestamps; // per input
+    std::vector<cv::Mat> keyGrays; // per input: tracking image (detection_interval > 1)
+    std::vector<cv::Rect> crops; // per input: motion region the network runs on (empty: whole image)
+};
+
+#define YOLO_NB_SLOTS 2 // double buffering between the pipeline stages
+
 // Declares a new MAPSComponent child class
 class MAPSOpenCV_Yolo : public MAPSComponent
 {
     // Use standard header definition macro
     MAPS_COMPONENT_STANDARD_HEADER_CODE(MAPSOpenCV_Yolo)
+    MAPS_COMPONENT_DYNAMIC_HEADER_CODE(MAPSOpenCV_Yolo)
 
 private:
-    void AllocateOutputBufferSize(const MAPSTimestamp /*ts*/, const MAPS::InputElt<IplImage> imageInElt);
-    void ProcessData(const MAPSTimestamp ts, const MAPS::InputElt<IplImage> inElt);
+    void AllocateOutputBufferSize(const MAPSTimestamp /*ts*/, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    void ProcessData(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    int AcquireBlobSlot();
+    void PushBlobSlot(int blobIndex);
+    void EnqueueBatch(const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    void UpdateTracks(const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    bool DetectMotion(const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    void RepeatDetections(const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts);
+    void MergeCropDetections(const cv::Rect& crop, const std::vector<YoloDetection>& previous, std::vector<YoloDetection>& detections);
+    void PrepareNetImage(const cv::Mat& imageIn, int batchIndex, YoloBlobTransform& transform);
+    void DiscardCutDetections(const cv::Rect& tile, const cv::Rect& image, size_t first, std::vector<YoloDetection>& detections);
+    void DecodeOutputs(const std::vector<cv::Mat>& outs, int batchIndex, const YoloBlobTransform& transform, float confThreshold, std::vector<YoloDetection>& detections);
+    void DecodeRows(const cv::Mat& out, const cv::Size2d& coordScale, const YoloBlobTransform& transform, float confThreshold, std::vector<YoloDetection>& detections);
+    void DecodeColumns(const cv::Mat& out, const YoloBlobTransform& transform, float confThreshold, std::vector<YoloDetection>& detections);
+    void WriteDetections(const MAPSTimestamp ts, int inputIndex, const std::vector<YoloDetection>& detections);
+    void StartPipeline(const std::string& configPath, const std::string& weightPath);
+    void StopPipeline();
+    void LoadingThread(std::string configPath, std::string weightPath);
+    void InferenceThread();
+    void DecodingThread();
+    void SetPipelineError(const char* message);
+    void WriteStatus(const char* status);
+    void WriteStats(MAPSTimestamp ts, const std::vector<double>& layersTimes, double totalTime);
     void DrawLabel(cv::Mat& input_image, std::string label, int left, int top);
 
 private:
 	std::unique_ptr<MAPS::InputReader> m_inputReader;
-    cv::dnn::DetectionModel m_model;
+    int m_nbInputs;
+    std::vector<MAPSInput*> m_inputs;
+    std::vector<YoloInputOutputs> m_outputs; // per input
+    MAPSOutput* m_statusOutput;
+    MAPSOutput* m_statsOutput; // nullptr when disabled
+    int m_maxDetections;
+    std::shared_ptr<YoloSharedModel> m_model;
+    int m_backend;
+    int m_target;
+    bool m_isOnnx; // ONNX export (YOLOv5/YOLOv8 output layouts) rather than darknet cfg/weights
     std::vector<std::string> m_classes;
+
+    cv::Size m_inputSize; // input_width x input_height properties (<= 0: image size)
+    int m_resizeMode;
+    cv::Size m_netSize; // network input size
+    bool m_swapRB;
+    int m_tileSize; // 0: no tiling
+    int m_tileOverlap;
+    std::vector<cv::Rect> m_imageRegions; // per input: full image
+    std::vector<cv::Rect> m_batchRegions; // per batch entry: full image or tile, in input image coordinates
+    std::vector<int> m_batchInputs; // per batch entry: input index
+    std::vector<int> m_inputFirstEntry; // per input: first batch entry (entries of input i: [m_inputFirstEntry[i], m_inputFirstEntry[i + 1][)
+    std::vector<cv::Mat> m_cvImagesIn; // per input: current image
+    std::vector<cv::Mat> m_netImages; // per batch entry: image resized (and letterboxed) to the network input size
+    std::vector<cv::Mat> m_batchImages; // per batch entry: network input image of the current batch (m_netImages or the input image itself)
+    std::vector<cv::Rect> m_letterboxRects; // per batch entry: image area of m_netImages in letterbox mode
+    bool m_motionGating;
+    bool m_motionCrop;
+    cv::Mat m_gatingColor;
+    cv::Mat m_gatingDiff;
+    std::vector<cv::Mat> m_gatingGrays; // per input: current downsampled gray image
+    std::vector<cv::Mat> m_gatingRefs; // per input: downsampled gray image the network last ran on
+    std::vector<cv::Rect> m_motionCrops; // per input
+    std::vector<std::vector<YoloDetection>> m_lastDetections; // per input: latest network detections (decoding thread only)
+    int m_detectionInterval; // the network runs every m_detectionInterval images, the tracker in between
+    MAPSInt64 m_frameCount;
+    std::vector<double> m_trackScales; // per input: tracking image size / input image size
+    std::vector<YoloTracker> m_trackers; // per input
+    std::vector<cv::Mat> m_fullGrays; // per input
+    std::vector<cv::Mat> m_grays; // per input: current tracking image
+    std::vector<cv::Mat> m_prevGrays; // per input: previous tracking image
+    std::vector<std::vector<YoloDetection>> m_pendingDetections; // per input: latest network detections, not yet merged into the tracks
+    std::vector<cv::Mat> m_pendingKeyGrays; // per input: tracking image the pending detections were computed on
+    bool m_hasPendingDetections;
+    std::vector<std::vector<YoloDetection>> m_newDetections; // component thread only
+    std::vector<cv::Mat> m_newKeyGrays; // component thread only
+    std::vector<YoloDetection> m_trackedDetections; // component thread only
+    std::vector<YoloBlobTransform> m_transforms; // inference thread only
+    std::vector<MAPSTimestamp> m_timestamps; // inference thread only
+    std::vector<cv::Mat> m_keyGrays; // inference thread only
+    std::vector<cv::Rect> m_crops; // inference thread only
+    std::vector<cv::Mat> m_forwardOuts; // inference thread only
+    std::vector<double> m_layersTimes; // inference thread only
+    std::vector<cv::String> m_layerNames; // inference thread only
+    std::vector<int> m_statsOrder; // inference thread only
+    std::vector<YoloDetection> m_candidates; // decoding thread only
+    std::vector<YoloDetection> m_detections; // decoding thread only
+    std::vector<float> m_maxScores; // decoding thread only
+    std::vector<int> m_classIds; // decoding thread only
+
+    // Pipeline: blob filling (component thread) -> forward pass (inference thread) -> decoding and outputs (decoding thread)
+    // The slot indices move between the free and ready queues below, under m_pipelineMutex.
+    YoloBlobSlot m_blobSlots[YOLO_NB_SLOTS];
+    YoloOutputSlot m_outputSlots[YOLO_NB_SLOTS];
+    std::deque<int> m_freeBlobSlots;
+    std::deque<int> m_readyBlobSlots;
+    std::deque<int> m_freeOutputSlots;
+    std::deque<int> m_readyOutputSlots;
+    std::mutex m_pipelineMutex;
+    std::condition_variable m_pipelineCond;
+    bool m_stopPipeline;
+    bool m_modelReady; // m_model is set once loaded and warmed up by the loading thread
+    int m_batchSize; // number of batch entries (tiles included), 0 until the first images are received
+    std::string m_pipelineError;
+    std::thread m_loadingThread;
+    std::thread m_inferenceThread;
+    std::thread m_decodingThread;
 };
@@ -29,12 +29,83 @@
 #include "maps_OpenCV_Calibration.h"    // Includes the header of this component
 
 #include <cstdio>  // sprintf...
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char     REMAP_CACHE_MAGIC[8] = { 'R', 'M', 'A', 'P', 'C', 'A', 'C', 'H' };
+    const uint32_t REMAP_CACHE_VERSION  = 2;
+    const int      REMAP_CACHE_MAX_DIST_COEFFS = 14;
+
+    const int    DETECTION_MAX_WIDTH    = 640; // the chessboard is searched on images downscaled to this width, then refined at full resolution
+    const size_t MAX_PENDING_DETECTIONS = 2;   // snapshots waiting for the detection thread: the oldest is dropped beyond that
+
+    // Layout of the binary remap cache file: this header, then map1 (CV_16SC2) and map2 (CV_16UC1) rows, without padding.
+    struct RemapCacheHeader
+    {
+        char     magic[8];
+        uint32_t version;
+        int32_t  width;
+        int32_t  height;
+        int32_t  undistMode;
+        double   alpha;
+        uint64_t calibrationHash;
+        int32_t  cameraModel;
+        double   intrinsicMatrix[9];
+        int32_t  nbDistortionCoeffs;
+        double   distortionCoeffs[REMAP_CACHE_MAX_DIST_COEFFS];
+        double   reprojectionError;
+    };
+
+    // FNV-1a: only used to detect that the calibration file has changed since the cache was written.
+    uint64_t HashBytes(const std::vector<char>& bytes)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (char c : bytes)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    unsigned long CurrentProcessId()
+    {
+#ifdef _WIN32
+        return static_cast<unsigned long>(GetCurrentProcessId());
+#else
+        return static_cast<unsigned long>(getpid());
+#endif
+    }
+}
 
 // Use the macros to declare the inputs
 MAPS_BEGIN_INPUTS_DEFINITION(MAPSOpenCV_Calibration)
     MAPS_INPUT("trigger", MAPS::FilterAny, MAPS::FifoReader)
     MAPS_INPUT("imageIn_fifo", MAPS::FilterIplImage, MAPS::LastOrNextReader)
     MAPS_INPUT("imageIn_sampling", MAPS::FilterIplImage, MAPS::SamplingReader)
+    MAPS_INPUT("points_int32", MAPS::FilterInteger32, MAPS::FifoReader)
+    MAPS_INPUT("points_float32", MAPS::FilterFloat32, MAPS::FifoReader)
+    MAPS_INPUT("objects", MAPS::FilterDrawingObjects, MAPS::FifoReader)
+    MAPS_INPUT("imageIn_left", MAPS::FilterIplImage, MAPS::FifoReader)
+    MAPS_INPUT("imageIn_right", MAPS::FilterIplImage, MAPS::FifoReader)
 MAPS_END_INPUTS_DEFINITION
 
 // Use the macros to declare the outputs
@@ -43,11 +114,18 @@ MAPS_BEGIN_OUTPUTS_DEFINITION(MAPSOpenCV_Calibration)
     MAPS_OUTPUT("intrinsic_matrix", MAPS::Matrix, nullptr, nullptr, 0)
     MAPS_OUTPUT("distortion_coeffs", MAPS::Matrix, nullptr, nullptr, 0)
     MAPS_OUTPUT("reprojection_error", MAPS::Float64, nullptr, nullptr, 1)
+    MAPS_OUTPUT("undistorted_points_int32", MAPS::Integer32, nullptr, nullptr, 0)
+    MAPS_OUTPUT("undistorted_points_float32", MAPS::Float32, nullptr, nullptr, 0)
+    MAPS_OUTPUT("undistorted_objects", MAPS::DrawingObject, nullptr, nullptr, 0)
+    MAPS_OUTPUT("oImage_right", MAPS::IplImage, nullptr, nullptr, 0)
+    MAPS_OUTPUT("disparity_to_depth_matrix", MAPS::Matrix, nullptr, nullptr, 0)
 MAPS_END_OUTPUTS_DEFINITION
 
 // Use the macros to declare the properties
 MAPS_BEGIN_PROPERTIES_DEFINITION(MAPSOpenCV_Calibration)
     MAPS_PROPERTY_ENUM("mode", "Run calibration procedure, save calib files and undistort|Load calib files and undistort", 0, false, false)
+    MAPS_PROPERTY("stereo", false, false, false)
+    MAPS_PROPERTY("synchro_tolerance", 0, false, false)
 
     // Run calibration procedure, save calib files and undistort
     MAPS_PROPERTY("number_of_snapshots_of_the_chessboard", 8, false, false)
@@ -55,6 +133,7 @@ MAPS_BEGIN_PROPERTIES_DEFINITION(MAPSOpenCV_Calibration)
     MAPS_PROPERTY("enclosed_corners_vertically_on_the_chessboard", 5, false, false)
     MAPS_PROPERTY("pattern_rectangle_width_meters", 0.032, false, false)
     MAPS_PROPERTY("pattern_rectangle_height_meters", 0.032, false, false)
+    MAPS_PROPERTY_ENUM("camera_model", "Pinhole|Fisheye", 0, false, false)
     MAPS_PROPERTY_SUBTYPE("folder_path", static_cast<const char*>(nullptr), false, true, MAPS::PropertySubTypePath|MAPS::PropertySubTypeMustExist)
     MAPS_PROPERTY("create_subfolders", true, false, false)
     MAPS_PROPERTY("save_calibration_images", true, false, false)
@@ -66,6 +145,12 @@ MAPS_BEGIN_PROPERTIES_DEFINITION(MAPSOpenCV_Calibration)
     MAPS_PROPERTY_SUBTYPE("file_path", static_cast<const char*>(nullptr), false, true, MAPS::PropertySubTypeFile|MAPS::PropertySubTypeMustExist)
     MAPS_PROPERTY_ENUM("undist_mode","Default|No cropping (all pixels, extra black zones - alpha = 1.0)|Optimized cropping (minimum unwanted pixels, pixels removed at corners - alpha = 0.0)|Custom",0, false, false)
     MAPS_PROPERTY("alpha",0.0,false,false)
+    MAPS_PROPERTY("use_remap_cache", true, false, false)
+    MAPS_PROPERTY("image_input", true, false, false)
+    MAPS_PROPERTY_ENUM("points_input", "None|Integer32|Float32", 0, false, false)
+    MAPS_PROPERTY("max_points", 1024, false, false)
+    MAPS_PROPERTY("objects_input", false, false, false)
+    MAPS_PROPERTY("max_objects", 256, false, false)
 MAPS_END_PROPERTIES_DEFINITION
 
 #define UNDIST_MODE_DEFAULT     0
@@ -79,10 +164,10 @@ MAPS_BEGIN_ACTIONS_DEFINITION(MAPSOpenCV_Calibration)
 MAPS_END_ACTIONS_DEFINITION
 
 // Use the macros to declare this component (Calibration) behaviour
-MAPS_COMPONENT_DEFINITION(MAPSOpenCV_Calibration, "OpenCV_Calibration", "2.2.0", 128,
+MAPS_COMPONENT_DEFINITION(MAPSOpenCV_Calibration, "OpenCV_Calibration", "2.8.3", 128,
               MAPS::Threaded, MAPS::Threaded,
                0, // Nb of inputs. Leave -1 to use the number of declared input definitions
-              -1, // Nb of outputs. Leave -1 to use the number of declared output definitions
+               4, // Nb of outputs. Leave -1 to use the number of declared output definitions
                1, // Nb of properties. Leave -1 to use the number of declared property definitions
               -1) // Nb of actions. Leave -1 to use the number of declared action definitions
 
@@ -98,10 +183,21 @@ void MAPSOpenCV_Calibration::UpdateOperationModeProperty()
         NewProperty("enclosed_corners_vertically_on_the_chessboard");
         NewProperty("pattern_rectangle_width_meters");
         NewProperty("pattern_rectangle_height_meters");
+        UpdateStereoProperty();
+        if (!m_stereo)
+        {
+            NewProperty("camera_model");
+            m_cameraModel = static_cast<int>(GetIntegerProperty("camera_model"));
+        }
+        else
+        {
+            m_cameraModel = CameraModel_Pinhole;
+        }
         NewProperty("folder_path");
         NewProperty("create_subfolders");
         NewProperty("save_calibration_images");
-        NewProperty("capture_mode");
+        if (!m_stereo)
+            NewProperty("capture_mode");
         break;
     case 1:
         m_operationMode = OperationMode_LoadUndistort;
@@ -114,11 +210,49 @@ void MAPSOpenCV_Calibration::UpdateOperationModeProperty()
             NewProperty("alpha");
             m_alpha = GetFloatProperty("alpha");
         }
+        UpdateStereoProperty();
+        if (m_stereo)
+        {
+            //The rectified pair is only computed from the images
+            m_useRemapCache = false;
+            m_useImageInput = true;
+            m_pointsInput = PointsInput_None;
+            m_useObjectsInput = false;
+            break;
+        }
+
+        NewProperty("use_remap_cache");
+        m_useRemapCache = GetBoolProperty("use_remap_cache");
+
+        NewProperty("image_input");
+        m_useImageInput = GetBoolProperty("image_input");
+        NewProperty("points_input");
+        m_pointsInput = static_cast<int>(GetIntegerProperty("points_input"));
+        if (m_pointsInput != PointsInput_None)
+        {
+            NewProperty("max_points");
+            m_maxPoints = static_cast<int>(GetIntegerProperty("max_points"));
+        }
+        NewProperty("objects_input");
+        m_useObjectsInput = GetBoolProperty("objects_input");
+        if (m_useObjectsInput)
+        {
+            NewProperty("max_objects");
+            m_maxObjects = static_cast<int>(GetIntegerProperty("max_objects"));
+        }
 
         break;
     }
 }
 
+void MAPSOpenCV_Calibration::UpdateStereoProperty()
+{
+    NewProperty("stereo");
+    m_stereo = GetBoolProperty("stereo");
+    if (m_stereo)
+        NewProperty("synchro_tolerance");
+}
+
 void MAPSOpenCV_Calibration::UpdateCaptureModeProperty()
 {
     m_captureMode = static_cast<int>(GetIntegerProperty("capture_mode"));
@@ -145,7 +279,17 @@ void MAPSOpenCV_Calibration::Dynamic()
         m_saveCalibrationImages = GetBoolProperty("save_calibration_images");
 
         UpdateFolderPathProperty();
-        UpdateCaptureModeProperty();
+        if (m_stereo)
+        {
+            //The pairs are synchronized: the snapshots are taken periodically, based on the images timestamps
+            m_captureMode = CaptureMode_Periodic;
+            NewProperty("capture_period_ms");
+            m_capturePeriodUs = static_cast<MAPSDelay>(GetIntegerProperty("capture_period_ms") * 1000);
+        }
+        else
+        {
+            UpdateCaptureModeProperty();
+        }
 
         // pattern info
         m_rectWidth  = GetFloatProperty("pattern_rectangle_width_meters");
@@ -155,17 +299,55 @@ void MAPSOpenCV_Calibration::Dynamic()
         m_boardW    = static_cast<int>(GetIntegerProperty("enclosed_corners_horizontally_on_the_chessboard"));
         m_boardH    = static_cast<int>(GetIntegerProperty("enclosed_corners_vertically_on_the_chessboard"));
 
-        NewInput(2, "imageIn");
+        if (m_stereo)
+            CreateStereoInputsOutputs();
+        else
+            NewInput(2, "imageIn");
         break;
 
     case OperationMode_LoadUndistort:
         UpdateFilePathProperty();
-        NewInput(1, "imageIn");
+        if (m_stereo)
+        {
+            CreateStereoInputsOutputs();
+            m_pointsOutput = nullptr;
+            m_objectsOutput = nullptr;
+            break;
+        }
+        if (m_useImageInput)
+            NewInput(1, "imageIn");
+
+        m_pointsOutput = nullptr;
+        if (m_pointsInput == PointsInput_Integer32)
+        {
+            NewInput(3, "points");
+            m_pointsOutput = &NewOutput(4, "undistorted_points");
+        }
+        else if (m_pointsInput == PointsInput_Float32)
+        {
+            NewInput(4, "points");
+            m_pointsOutput = &NewOutput(5, "undistorted_points");
+        }
+
+        m_objectsOutput = nullptr;
+        if (m_useObjectsInput)
+        {
+            NewInput(5, "objects");
+            m_objectsOutput = &NewOutput(6, "undistorted_objects");
+        }
         break;
     }
 
 }
 
+void MAPSOpenCV_Calibration::CreateStereoInputsOutputs()
+{
+    NewInput(6, "imageIn_left");
+    NewInput(7, "imageIn_right");
+    m_rightImageOutput = &NewOutput(7, "oImage_right");
+    m_disparityToDepthOutput = &NewOutput(8, "disparity_to_depth_matrix");
+}
+
 void MAPSOpenCV_Calibration::UpdateFolderPathProperty()
 {
     if (m_operationMode == OperationMode_CalibSaveUndistort)
@@ -226,6 +408,17 @@ void MAPSOpenCV_Calibration::Birth()
         CreateSubFolder();
 
         m_calibrated = false;
+        if (m_operationMode == OperationMode_LoadUndistort)
+            m_cameraModel = CameraModel_Pinhole; // read from the calibration file
+        m_undistMap1.release();
+        m_undistMap2.release();
+
+        //The undist_mode property only exists in the loading mode: after a calibration, the default undistortion is applied
+        if (m_operationMode == OperationMode_CalibSaveUndistort)
+        {
+            m_undistMode = UNDIST_MODE_DEFAULT;
+            m_useRemapCache = false;
+        }
 
         if (m_operationMode == OperationMode_CalibSaveUndistort)
         {
@@ -240,39 +433,90 @@ void MAPSOpenCV_Calibration::Birth()
 
             m_rvecs.clear(); m_rvecs.reserve(m_nBoards);
             m_tvecs.clear(); m_tvecs.reserve(m_nBoards);
+            m_imagePointsRight.clear(); m_imagePointsRight.reserve(m_nBoards);
+            m_lastCaptureTs = MAPSTimestamp(-1);
 
-            switch (m_captureMode)
+            StartCollection();
+
+            if (m_stereo)
             {
-            case CaptureMode_Triggered:
-                m_inputReader = MAPS::MakeInputReader::Triggered(
-                    this,
-                    Input("trigger"),
-                    MAPS::InputReaderOption::Triggered::TriggerKind::DataInput,
-                    MAPS::InputReaderOption::Triggered::SamplingBehavior::WaitForAllInputs,
-                    MAPS::MakeArray(&Input(0), &Input(1)),
-                    &MAPSOpenCV_Calibration::AllocateOutputBufferSize_Triggered,
-                    &MAPSOpenCV_Calibration::ProcessData_Triggered
-                );
-                break;
-            case CaptureMode_Periodic:
-                m_inputReader = MAPS::MakeInputReader::PeriodicSampling(
-                    this,
-                    m_capturePeriodUs,
-                    Input("imageIn"),
-                    &MAPSOpenCV_Calibration::AllocateOutputBufferSize_Periodic,
-                    &MAPSOpenCV_Calibration::ProcessData_Periodic
-                );
-                break;
-            default:
-                break;
+                m_inputReader = MakeStereoInputReader();
+            }
+            else
+            {
+                switch (m_captureMode)
+                {
+                case CaptureMode_Triggered:
+                    m_inputReader = MAPS::MakeInputReader::Triggered(
+                        this,
+                        Input("trigger"),
+                        MAPS::InputReaderOption::Triggered::TriggerKind::DataInput,
+                        MAPS::InputReaderOption::Triggered::SamplingBehavior::WaitForAllInputs,
+                        MAPS::MakeArray(&Input(0), &Input(1)),
+                        &MAPSOpenCV_Calibration::AllocateOutputBufferSize_Triggered,
+                        &MAPSOpenCV_Calibration::ProcessData_Triggered
+                    );
+                    break;
+                case CaptureMode_Periodic:
+                    m_inputReader = MAPS::MakeInputReader::PeriodicSampling(
+                        this,
+                        m_capturePeriodUs,
+                        Input("imageIn"),
+                        &MAPSOpenCV_Calibration::AllocateOutputBufferSize_Periodic,
+                        &MAPSOpenCV_Calibration::ProcessData_Periodic
+                    );
+                    break;
+                default:
+                    break;
+                }
             }
         }
+        else if (m_stereo)
+        {
+            m_inputReader = MakeStereoInputReader();
+        }
         else
         {
+            //The image, points and objects inputs are independent streams: each one is processed as soon as it answers
+            m_inputs.clear();
+            m_imageInputIndex = m_pointsInputIndex = m_objectsInputIndex = -1;
+            if (m_useImageInput)
+            {
+                m_imageInputIndex = static_cast<int>(m_inputs.size());
+                m_inputs.push_back(&Input("imageIn"));
+            }
+            if (m_pointsInput != PointsInput_None)
+            {
+                m_pointsInputIndex = static_cast<int>(m_inputs.size());
+                m_inputs.push_back(&Input("points"));
+                m_pointsOutput->AllocOutputBuffer(2 * m_maxPoints);
+            }
+            if (m_useObjectsInput)
+            {
+                m_objectsInputIndex = static_cast<int>(m_inputs.size());
+                m_inputs.push_back(&Input("objects"));
+                m_objectsOutput->AllocOutputBuffer(m_maxObjects);
+            }
+            if (m_inputs.empty())
+                Error("At least one of the image, points or objects inputs must be enabled.");
+
+            //Without images, the calibration data is output along with the points and objects
+            if (!m_useImageInput)
+            {
+                Output("intrinsic_matrix").AllocOutputBufferMatrix(3, 3);
+                Output("distortion_coeffs").AllocOutputBufferMatrix(5, 1);
+            }
+
+            m_imageSize = cv::Size();
+            m_calibrationImageSize = cv::Size();
+            m_imageBuffersAllocated = false;
+            m_pointsNewMatrix.release();
+
             m_inputReader = MAPS::MakeInputReader::Reactive(
                 this,
-                Input("imageIn"),
-                &MAPSOpenCV_Calibration::AllocateOutputBufferSize_Periodic,
+                MAPS::InputReaderOption::Reactive::FirstTimeBehavior::Immediate,
+                MAPS::InputReaderOption::Reactive::Buffering::Enabled,
+                m_inputs,
                 &MAPSOpenCV_Calibration::ProcessData_Reactive
             );
         }
@@ -287,6 +531,19 @@ void MAPSOpenCV_Calibration::Birth()
     }
 }
 
+std::unique_ptr<MAPS::InputReader> MAPSOpenCV_Calibration::MakeStereoInputReader()
+{
+    m_imageSize = cv::Size();
+    return MAPS::MakeInputReader::Synchronized(
+        this,
+        GetIntegerProperty("synchro_tolerance"),
+        MAPS::InputReaderOption::Synchronized::SyncBehavior::SyncAllInputs,
+        MAPS::MakeArray(&Input("imageIn_left"), &Input("imageIn_right")),
+        &MAPSOpenCV_Calibration::AllocateOutputBufferSize_Stereo,
+        &MAPSOpenCV_Calibration::ProcessData_Stereo
+    );
+}
+
 void MAPSOpenCV_Calibration::Core()
 {
     m_inputReader->Read();
@@ -295,18 +552,36 @@ void MAPSOpenCV_Calibration::Core()
 void MAPSOpenCV_Calibration::Death()
 {
     m_inputReader.reset();
+    m_inputs.clear();
+    StopCollection();
+
+    // The maps may point into the mapped cache file
+    m_undistMap1.release();
+    m_undistMap2.release();
+    m_remapCacheFile.Close();
 }
 
-void MAPSOpenCV_Calibration::Core_Calibrate_Actual(MAPSTimestamp ts, const IplImage& imageIn)
+void MAPSOpenCV_Calibration::Core_Calibrate_Actual(MAPSTimestamp ts, const IplImage& imageIn, const IplImage* rightImageIn)
 {
-    if (m_successes < m_nBoards)
+    int successes;
+    std::string collectError;
     {
-        CollectImage(ts, imageIn);
+        std::lock_guard<std::mutex> lock(m_collectMutex);
+        successes = m_successes;
+        collectError = m_collectError;
     }
+    if (!collectError.empty())
+        Error(collectError.c_str());
 
-    if (m_successes >= m_nBoards && !m_calibrated)
+    //The snapshots are collected by the detection thread: the calibration starts at the first image after the last one
+    if (successes < m_nBoards)
+    {
+        CollectImage(ts, imageIn, rightImageIn);
+    }
+    else if (!m_calibrated)
     {
         CalibrateCamera();
+        ComputeUndistortMaps();
         SaveCalibration();
 
         m_calibrated = true;
@@ -360,24 +635,71 @@ void MAPSOpenCV_Calibration::AllocateBuffers(const IplImage& iplImageIn)
     Output("distortion_coeffs").AllocOutputBufferMatrix(5, 1);
 }
 
+void MAPSOpenCV_Calibration::StartCollection()
+{
+    m_stopCollecting = false;
+    m_collectError.clear();
+    m_detectionJobs.clear();
+    m_pendingSaves.clear();
+    m_detectionThread = std::thread(&MAPSOpenCV_Calibration::DetectionThread, this);
+    m_savingThread = std::thread(&MAPSOpenCV_Calibration::SavingThread, this);
+}
+
+void MAPSOpenCV_Calibration::StopCollection()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_collectMutex);
+        m_stopCollecting = true;
+    }
+    m_collectCond.notify_all();
+
+    //The saving thread writes the images still in its queue before exiting
+    if (m_detectionThread.joinable())
+        m_detectionThread.join();
+    if (m_savingThread.joinable())
+        m_savingThread.join();
+}
+
+// Errors cannot be raised from the collection threads: they are reported on the component thread at the next image.
+void MAPSOpenCV_Calibration::SetCollectError(const MAPSString& message)
+{
+    std::lock_guard<std::mutex> lock(m_collectMutex);
+    if (m_collectError.empty())
+        m_collectError = static_cast<const char*>(message);
+}
+
+// Searches the chessboard on a downscaled copy of the image (with a fast rejection when there is none),
+// then refines the corners on the full resolution image.
 bool MAPSOpenCV_Calibration::DetectPattern(cv::Mat& grayImage, std::vector<cv::Point2f>& detectedCorners)
 {
     detectedCorners.clear();
     detectedCorners.reserve(m_boardTotal);
 
+    const double scale = grayImage.cols > DETECTION_MAX_WIDTH ? static_cast<double>(DETECTION_MAX_WIDTH) / grayImage.cols : 1.0;
+    cv::Mat smallImage;
+    if (scale < 1.0)
+        cv::resize(grayImage, smallImage, cv::Size(), scale, scale, cv::INTER_AREA);
+    else
+        smallImage = grayImage;
+
     const bool found = cv::findChessboardCorners(
-        grayImage,
+        smallImage,
         m_boardSz,
         detectedCorners,
-        cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_FILTER_QUADS + cv::CALIB_CB_NORMALIZE_IMAGE
+        cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_FILTER_QUADS + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK
     );
 
     if (found)
     {
+        //The search window must cover the localization error of the downscaled detection
+        const int halfWindow = std::max(11, cvCeil(2.0 / scale));
+        for (cv::Point2f& corner : detectedCorners)
+            corner *= static_cast<float>(1.0 / scale);
+
         cv::cornerSubPix(
             grayImage,
             detectedCorners,
-            cv::Size(11, 11),
+            cv::Size(halfWindow, halfWindow),
             cv::Size(-1, -1),
             cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1)
         );
@@ -386,81 +708,191 @@ bool MAPSOpenCV_Calibration::DetectPattern(cv::Mat& grayImage, std::vector<cv::P
     return found;
 }
 
-void MAPSOpenCV_Calibration::CollectImage(MAPSTimestamp ts, const IplImage& iplImageIn)
+// Hands a copy of the image over to the detection thread, so that a slow (or unsuccessful) chessboard search never
+// blocks the component thread.
+void MAPSOpenCV_Calibration::CollectImage(MAPSTimestamp ts, const IplImage& iplImageIn, const IplImage* rightIplImageIn)
 {
-    const MAPSUInt32 imageInChannelSeq = *(MAPSUInt32*)iplImageIn.channelSeq;
-    cv::Mat          imageIn = convTools::noCopyIplImage2Mat(&iplImageIn);
-
-    ReportInfo("Collecting images...\n");
-
-    cv::Mat gray_image;
-
-    switch (imageInChannelSeq)
+    DetectionJob job;
+    job.ts = ts;
+    job.channelSeq = *(MAPSUInt32*)iplImageIn.channelSeq;
+    convTools::noCopyIplImage2Mat(&iplImageIn).copyTo(job.image);
+    if (rightIplImageIn != nullptr)
+        convTools::noCopyIplImage2Mat(rightIplImageIn).copyTo(job.rightImage);
+
+    bool skipped = false;
     {
-        case MAPS_CHANNELSEQ_BGR: cv::cvtColor(imageIn, gray_image, cv::COLOR_BGR2GRAY); break;
-        case MAPS_CHANNELSEQ_RGB: cv::cvtColor(imageIn, gray_image, cv::COLOR_RGB2GRAY); break;
-        case MAPS_CHANNELSEQ_BGRA: cv::cvtColor(imageIn, gray_image, cv::COLOR_BGRA2GRAY); break;
-        case MAPS_CHANNELSEQ_RGBA: cv::cvtColor(imageIn, gray_image, cv::COLOR_RGBA2GRAY); break;
-        default: gray_image = imageIn; break;
+        std::lock_guard<std::mutex> lock(m_collectMutex);
+        if (m_detectionJobs.size() >= MAX_PENDING_DETECTIONS)
+        {
+            m_detectionJobs.pop_front();
+            skipped = true;
+        }
+        m_detectionJobs.push_back(std::move(job));
     }
+    m_collectCond.notify_all();
 
-    std::vector<cv::Point2f> detectedCorners;
-    const bool found = DetectPattern(gray_image, detectedCorners);
+    if (skipped)
+        ReportInfo("Chessboard detection is busy: skipping the oldest pending snapshot.");
+}
 
-    // If we got a good board, add it to our data
-    if (found && detectedCorners.size() == m_boardTotal)
+bool MAPSOpenCV_Calibration::DetectBoard(const cv::Mat& image, MAPSUInt32 channelSeq, std::vector<cv::Point2f>& detectedCorners)
+{
+    cv::Mat gray_image;
+    switch (channelSeq)
     {
-        ++m_successes;
+        case MAPS_CHANNELSEQ_BGR: cv::cvtColor(image, gray_image, cv::COLOR_BGR2GRAY); break;
+        case MAPS_CHANNELSEQ_RGB: cv::cvtColor(image, gray_image, cv::COLOR_RGB2GRAY); break;
+        case MAPS_CHANNELSEQ_BGRA: cv::cvtColor(image, gray_image, cv::COLOR_BGRA2GRAY); break;
+        case MAPS_CHANNELSEQ_RGBA: cv::cvtColor(image, gray_image, cv::COLOR_RGBA2GRAY); break;
+        default: gray_image = image; break;
+    }
 
-        m_imagePoints.push_back(detectedCorners);
-        m_objectPoints.push_back(m_realGrid);
+    return DetectPattern(gray_image, detectedCorners) && detectedCorners.size() == static_cast<size_t>(m_boardTotal);
+}
 
-        MAPS::OutputGuard<IplImage> outGuard{ this, Output(0) };
-        outGuard.Timestamp() = ts;
-        outGuard.VectorSize() = 0;
+// Outputs the snapshot with its detected corners, and keeps a copy of it when the images are saved.
+void MAPSOpenCV_Calibration::DrawBoard(MAPSOutput& output, MAPSTimestamp ts, const cv::Mat& image, const std::vector<cv::Point2f>& corners, cv::Mat& withCorners)
+{
+    MAPS::OutputGuard<IplImage> outGuard{ this, output };
+    outGuard.Timestamp() = ts;
+    outGuard.VectorSize() = 0;
 
-        cv::Mat imageOut = convTools::noCopyIplImage2Mat(&outGuard.Data());
-        imageIn.copyTo(imageOut);
-        cv::drawChessboardCorners(imageOut, m_boardSz, cv::Mat(detectedCorners), found);
+    cv::Mat imageOut = convTools::noCopyIplImage2Mat(&outGuard.Data());
+    image.copyTo(imageOut);
+    cv::drawChessboardCorners(imageOut, m_boardSz, cv::Mat(corners), true);
+    if (m_saveCalibrationImages)
+        imageOut.copyTo(withCorners);
+}
 
-        SaveCollectedImage(imageIn, imageOut);
+void MAPSOpenCV_Calibration::DetectionThread()
+{
+    try
+    {
+        std::unique_lock<std::mutex> lock(m_collectMutex);
+        for (;;)
+        {
+            m_collectCond.wait(lock, [this] { return m_stopCollecting || !m_detectionJobs.empty(); });
+            if (m_stopCollecting)
+                return;
+            DetectionJob job = std::move(m_detectionJobs.front());
+            m_detectionJobs.pop_front();
+            lock.unlock();
+
+            ReportInfo("Collecting images...\n");
+
+            //In stereo, the board must be found in both images of the pair
+            const bool stereo = !job.rightImage.empty();
+            std::vector<cv::Point2f> detectedCorners, detectedCornersRight;
+            bool found = DetectBoard(job.image, job.channelSeq, detectedCorners);
+            if (found && stereo)
+                found = DetectBoard(job.rightImage, job.channelSeq, detectedCornersRight);
+
+            // If we got a good board, add it to our data
+            lock.lock();
+            if (!found)
+            {
+                lock.unlock();
+                ReportInfo("No corners detected");
+                lock.lock();
+                continue;
+            }
+            if (m_successes >= m_nBoards)
+                continue;
+            lock.unlock();
+
+            cv::Mat withCorners, rightWithCorners;
+            DrawBoard(Output(0), job.ts, job.image, detectedCorners, withCorners);
+            if (stereo)
+                DrawBoard(*m_rightImageOutput, job.ts, job.rightImage, detectedCornersRight, rightWithCorners);
+
+            lock.lock();
+            m_imagePoints.push_back(detectedCorners);
+            m_objectPoints.push_back(m_realGrid);
+            if (stereo)
+                m_imagePointsRight.push_back(detectedCornersRight);
+            const int successes = ++m_successes;
+            if (m_saveCalibrationImages)
+            {
+                PendingSave save;
+                save.index = successes;
+                save.prefix = stereo ? "left_" : "";
+                save.original = job.image;
+                save.withCorners = withCorners;
+                m_pendingSaves.push_back(save);
+                if (stereo)
+                {
+                    save.prefix = "right_";
+                    save.original = job.rightImage;
+                    save.withCorners = rightWithCorners;
+                    m_pendingSaves.push_back(save);
+                }
+                m_collectCond.notify_all();
+            }
+            lock.unlock();
 
-        MAPSStreamedString sx;
-        ReportInfo(sx
-            << m_successes << " successful Snapshots out of " << m_nBoards << " collected."
-        );
+            MAPSStreamedString sx;
+            ReportInfo(sx
+                << successes << " successful Snapshots out of " << m_nBoards << " collected."
+            );
+            lock.lock();
+        }
     }
-    else
+    catch (const std::exception& e)
     {
-        ReportInfo("No corners detected");
+        SetCollectError(e.what());
     }
 }
 
-void MAPSOpenCV_Calibration::SaveCollectedImage(cv::Mat& original, cv::Mat& withCorners)
+// Encodes and writes the collected images in the background; the remaining ones are still written when stopping.
+void MAPSOpenCV_Calibration::SavingThread()
 {
-    if (m_saveCalibrationImages)
+    try
     {
-        MAPSIconv::localeChar* path = MAPSIconv::UTF8ToLocale(m_folderPath);
-        char buf[512];
-
-        sprintf(buf, "%s/original_%04d-%04d.png", path, m_successes, m_nBoards);
-        if (!cv::imwrite(buf, original))
+        std::unique_lock<std::mutex> lock(m_collectMutex);
+        for (;;)
         {
-            MAPSIconv::releaseLocale(path);
-            MAPSStreamedString sx;
-            Error(sx << "Failed to save image [" << buf << "]");
-        }
+            m_collectCond.wait(lock, [this] { return m_stopCollecting || !m_pendingSaves.empty(); });
+            if (m_pendingSaves.empty())
+                return;
+            PendingSave save = std::move(m_pendingSaves.front());
+            m_pendingSaves.pop_front();
+            lock.unlock();
 
-        sprintf(buf, "%s/corners_%04d-%04d.png", path, m_successes, m_nBoards);
-        if (!cv::imwrite(buf, withCorners))
-        {
-            MAPSIconv::releaseLocale(path);
-            MAPSStreamedString sx;
-            Error(sx << "Failed to save image [" << buf << "]");
+            SaveCollectedImage(save.index, save.prefix, save.original, save.withCorners);
+
+            lock.lock();
         }
+    }
+    catch (const std::exception& e)
+    {
+        SetCollectError(e.what());
+    }
+}
+
+void MAPSOpenCV_Calibration::SaveCollectedImage(int index, const char* prefix, const cv::Mat& original, const cv::Mat& withCorners)
+{
+    MAPSIconv::localeChar* path = MAPSIconv::UTF8ToLocale(m_folderPath);
+    char buf[512];
+
+    sprintf(buf, "%s/%soriginal_%04d-%04d.png", path, prefix, index, m_nBoards);
+    if (!cv::imwrite(buf, original))
+    {
+        MAPSIconv::releaseLocale(path);
+        MAPSStreamedString sx;
+        SetCollectError(sx << "Failed to save image [" << buf << "]");
+        return;
+    }
 
+    sprintf(buf, "%s/%scorners_%04d-%04d.png", path, prefix, index, m_nBoards);
+    if (!cv::imwrite(buf, withCorners))
+    {
         MAPSIconv::releaseLocale(path);
+        MAPSStreamedString sx;
+        SetCollectError(sx << "Failed to save image [" << buf << "]");
+        return;
     }
+
+    MAPSIconv::releaseLocale(path);
 }
 
 void MAPSOpenCV_Calibration::CalibrateCamera()
@@ -468,16 +900,35 @@ void MAPSOpenCV_Calibration::CalibrateCamera()
     ReportInfo("\n\n *** Calibrating the camera now...\n");
 
     m_intrinsicMatrix = cv::Mat::eye(3, 3, CV_64F);
-    m_distortionCoeffs = cv::Mat::zeros(8, 1, CV_64F);
-    m_reprojectionError = cv::calibrateCamera(
-        m_objectPoints,
-        m_imagePoints,
-        m_imageSize,
-        m_intrinsicMatrix,
-        m_distortionCoeffs,
-        m_rvecs,
-        m_tvecs
-    );
+    if (m_cameraModel == CameraModel_Fisheye)
+    {
+        //Equidistant model with 4 coefficients (k1..k4), suited to fields of view up to and beyond 180 degrees
+        m_distortionCoeffs = cv::Mat::zeros(4, 1, CV_64F);
+        m_reprojectionError = cv::fisheye::calibrate(
+            m_objectPoints,
+            m_imagePoints,
+            m_imageSize,
+            m_intrinsicMatrix,
+            m_distortionCoeffs,
+            m_rvecs,
+            m_tvecs,
+            cv::fisheye::CALIB_RECOMPUTE_EXTRINSIC | cv::fisheye::CALIB_FIX_SKEW,
+            cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100, DBL_EPSILON)
+        );
+    }
+    else
+    {
+        m_distortionCoeffs = cv::Mat::zeros(8, 1, CV_64F);
+        m_reprojectionError = cv::calibrateCamera(
+            m_objectPoints,
+            m_imagePoints,
+            m_imageSize,
+            m_intrinsicMatrix,
+            m_distortionCoeffs,
+            m_rvecs,
+            m_tvecs
+        );
+    }
 
     //_____________________________________________________________________________________
 
@@ -491,9 +942,47 @@ void MAPSOpenCV_Calibration::CalibrateCamera()
     // Save the intrinsics, distortions and extrinsic
 
     //Save values to file
+    if (m_stereo)
+        CalibrateStereo();
+
     ReportInfo(" *** Calibration Done!\n\n");
 }
 
+// The left camera is calibrated by CalibrateCamera: the right one is calibrated the same way, then the pose of the
+// right camera relatively to the left one is estimated with the intrinsics fixed.
+void MAPSOpenCV_Calibration::CalibrateStereo()
+{
+    m_intrinsicMatrixRight = cv::Mat::eye(3, 3, CV_64F);
+    m_distortionCoeffsRight = cv::Mat::zeros(8, 1, CV_64F);
+    std::vector<cv::Mat> rvecs, tvecs;
+    cv::calibrateCamera(
+        m_objectPoints,
+        m_imagePointsRight,
+        m_imageSize,
+        m_intrinsicMatrixRight,
+        m_distortionCoeffsRight,
+        rvecs,
+        tvecs
+    );
+
+    m_reprojectionError = cv::stereoCalibrate(
+        m_objectPoints,
+        m_imagePoints,
+        m_imagePointsRight,
+        m_intrinsicMatrix,
+        m_distortionCoeffs,
+        m_intrinsicMatrixRight,
+        m_distortionCoeffsRight,
+        m_imageSize,
+        m_stereoRotation,
+        m_stereoTranslation,
+        m_essentialMatrix,
+        m_fundamentalMatrix,
+        cv::CALIB_FIX_INTRINSIC,
+        cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100, 1e-6)
+    );
+}
+
 void MAPSOpenCV_Calibration::SaveCalibration()
 {
     MAPSStreamedString sx;
@@ -526,6 +1015,8 @@ void MAPSOpenCV_Calibration::SaveCalibration()
             << "rectangle_width" << m_rectWidth
             << "rectangle_height" << m_rectHeight
 
+            << "camera_model" << (m_cameraModel == CameraModel_Fisheye ? "fisheye" : "pinhole")
+
             << "intrinsic_matrix" << m_intrinsicMatrix
             << "distortion_coeffs" << m_distortionCoeffs
             << "reprojection_error" << m_reprojectionError
@@ -533,6 +1024,26 @@ void MAPSOpenCV_Calibration::SaveCalibration()
             << "rvecs" << m_rvecs
             << "tvecs" << m_tvecs;
 
+        //Stereo: the fields above describe the left camera, the reprojection error is the stereo one
+        if (m_stereo)
+        {
+            fs << "stereo" << 1
+
+                << "intrinsic_matrix_right" << m_intrinsicMatrixRight
+                << "distortion_coeffs_right" << m_distortionCoeffsRight
+
+                << "stereo_rotation" << m_stereoRotation
+                << "stereo_translation" << m_stereoTranslation
+                << "essential_matrix" << m_essentialMatrix
+                << "fundamental_matrix" << m_fundamentalMatrix
+
+                << "rectification_left" << m_rectificationLeft
+                << "rectification_right" << m_rectificationRight
+                << "projection_left" << m_projectionLeft
+                << "projection_right" << m_projectionRight
+                << "disparity_to_depth" << m_disparityToDepth;
+        }
+
         fs.release();
     }
 
@@ -543,6 +1054,15 @@ void MAPSOpenCV_Calibration::LoadCalibration()
 {
     if (!m_calibrated)
     {
+        //The remap cache depends on the image size: it can only be used here when the first data received is an image,
+        //otherwise it is used when the first image is received (see UndistortImage)
+        const bool imageSizeKnown = m_imageSize.area() > 0;
+        if (m_useRemapCache && imageSizeKnown && LoadRemapCache())
+        {
+            m_calibrated = true;
+            return;
+        }
+
         MAPSIconv::localeChar* path_locale = MAPSIconv::UTF8ToLocale(static_cast<const char*>(m_filePath));
         cv::FileStorage fs(path_locale, cv::FileStorage::READ);
         MAPSIconv::releaseLocale(path_locale);
@@ -552,8 +1072,39 @@ void MAPSOpenCV_Calibration::LoadCalibration()
             fs["distortion_coeffs"] >> m_distortionCoeffs;
             fs["reprojection_error"] >> m_reprojectionError;
 
+            //Files without camera model come from the pinhole-only versions
+            std::string cameraModel;
+            fs["camera_model"] >> cameraModel;
+            m_cameraModel = cameraModel == "fisheye" ? CameraModel_Fisheye : CameraModel_Pinhole;
+
+            if (m_stereo)
+            {
+                if (m_cameraModel == CameraModel_Fisheye)
+                {
+                    MAPSStreamedString sx;
+                    Error(sx << "[" << m_filePath << "] is a fisheye calibration file: the stereo mode only supports the pinhole model");
+                }
+                fs["intrinsic_matrix_right"] >> m_intrinsicMatrixRight;
+                fs["distortion_coeffs_right"] >> m_distortionCoeffsRight;
+                fs["stereo_rotation"] >> m_stereoRotation;
+                fs["stereo_translation"] >> m_stereoTranslation;
+                if (m_intrinsicMatrixRight.empty() || m_distortionCoeffsRight.empty() || m_stereoRotation.empty() || m_stereoTranslation.empty())
+                {
+                    MAPSStreamedString sx;
+                    Error(sx << "[" << m_filePath << "] is not a stereo calibration file");
+                }
+            }
+
+            int imageWidth = 0, imageHeight = 0;
+            fs["image_width"] >> imageWidth;
+            fs["image_height"] >> imageHeight;
+            m_calibrationImageSize = cv::Size(imageWidth, imageHeight);
+
             m_calibrated = true;
             fs.release();
+
+            if (imageSizeKnown)
+                UpdateUndistortMaps(false);
         }
         else
         {
@@ -565,35 +1116,552 @@ void MAPSOpenCV_Calibration::LoadCalibration()
     }
 }
 
-void MAPSOpenCV_Calibration::UndistortImage(MAPSTimestamp ts, const IplImage& iplImageIn)
+MAPSString MAPSOpenCV_Calibration::GetRemapCachePath() const
 {
-    cv::Mat imageIn = convTools::noCopyIplImage2Mat(&iplImageIn);
-    MAPS::OutputGuard<IplImage> outGuard{ this, Output(0) };
-    cv::Mat imageOut = convTools::noCopyIplImage2Mat(&outGuard.Data());
+    //Instances using different alpha values must not overwrite each other's cache file
+    MAPSStreamedString sx;
+    sx << m_filePath << "." << m_imageSize.width << "x" << m_imageSize.height << "_" << m_undistMode;
+    if (m_undistMode == UNDIST_MODE_CUSTOM)
+    {
+        char alpha[32];
+        snprintf(alpha, sizeof(alpha), "_alpha%g", m_alpha);
+        sx << alpha;
+    }
+    sx << ".remap";
+    return MAPSString(sx);
+}
+
+bool MAPSOpenCV_Calibration::ReadCalibrationFileHash(uint64_t& hash) const
+{
+    MAPSIconv::localeChar* path_locale = MAPSIconv::UTF8ToLocale(static_cast<const char*>(m_filePath));
+    std::ifstream file(path_locale, std::ios::binary);
+    MAPSIconv::releaseLocale(path_locale);
+    if (!file)
+        return false;
+
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    hash = HashBytes(bytes);
+    return true;
+}
+
+// Maps the cache file matching the current calibration file, image size and undistortion mode, and points
+// the undistortion maps straight into it: neither the XML parsing nor the maps generation are needed.
+bool MAPSOpenCV_Calibration::LoadRemapCache()
+{
+    uint64_t calibrationHash;
+    if (!ReadCalibrationFileHash(calibrationHash))
+        return false;
+
+    MAPSString cachePath = GetRemapCachePath();
+    MAPSIconv::localeChar* path_locale = MAPSIconv::UTF8ToLocale(static_cast<const char*>(cachePath));
+    bool opened = m_remapCacheFile.Open(path_locale);
+    MAPSIconv::releaseLocale(path_locale);
+    if (!opened)
+        return false;
+
+    const size_t map1Size = static_cast<size_t>(m_imageSize.area()) * 2 * sizeof(int16_t);
+    const size_t map2Size = static_cast<size_t>(m_imageSize.area()) * sizeof(uint16_t);
+    if (m_remapCacheFile.size != sizeof(RemapCacheHeader) + map1Size + map2Size)
+    {
+        m_remapCacheFile.Close();
+        return false;
+    }
+
+    RemapCacheHeader header;
+    std::memcpy(&header, m_remapCacheFile.data, sizeof(header));
+    const double alpha = m_undistMode == UNDIST_MODE_CUSTOM ? m_alpha : 0.0;
+    if (std::memcmp(header.magic, REMAP_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != REMAP_CACHE_VERSION
+        || header.width != m_imageSize.width
+        || header.height != m_imageSize.height
+        || header.undistMode != m_undistMode
+        || header.alpha != alpha
+        || header.calibrationHash != calibrationHash
+        || (header.cameraModel != CameraModel_Pinhole && header.cameraModel != CameraModel_Fisheye)
+        || header.nbDistortionCoeffs < 0
+        || header.nbDistortionCoeffs > REMAP_CACHE_MAX_DIST_COEFFS)
+    {
+        m_remapCacheFile.Close();
+        return false;
+    }
+
+    cv::Mat(3, 3, CV_64F, header.intrinsicMatrix).copyTo(m_intrinsicMatrix);
+    cv::Mat(header.nbDistortionCoeffs, 1, CV_64F, header.distortionCoeffs).copyTo(m_distortionCoeffs);
+    m_reprojectionError = header.reprojectionError;
+    m_cameraModel = header.cameraModel;
+
+    unsigned char* maps = const_cast<unsigned char*>(m_remapCacheFile.data) + sizeof(RemapCacheHeader);
+    m_undistMap1 = cv::Mat(m_imageSize, CV_16SC2, maps);
+    m_undistMap2 = cv::Mat(m_imageSize, CV_16UC1, maps + map1Size);
+
+    MAPSStreamedString sx;
+    ReportInfo(sx << "Undistortion maps loaded from the cache file [" << cachePath << "]");
+    return true;
+}
+
+void MAPSOpenCV_Calibration::SaveRemapCache()
+{
+    uint64_t calibrationHash;
+    if (!ReadCalibrationFileHash(calibrationHash))
+        return;
+
+    cv::Mat intrinsicMatrix, distortionCoeffs;
+    m_intrinsicMatrix.convertTo(intrinsicMatrix, CV_64F);
+    m_distortionCoeffs.convertTo(distortionCoeffs, CV_64F);
+    if (intrinsicMatrix.total() != 9 || distortionCoeffs.total() > static_cast<size_t>(REMAP_CACHE_MAX_DIST_COEFFS)
+        || !m_undistMap1.isContinuous() || !m_undistMap2.isContinuous())
+        return;
+
+    RemapCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, REMAP_CACHE_MAGIC, sizeof(header.magic));
+    header.version = REMAP_CACHE_VERSION;
+    header.width = m_imageSize.width;
+    header.height = m_imageSize.height;
+    header.undistMode = m_undistMode;
+    header.alpha = m_undistMode == UNDIST_MODE_CUSTOM ? m_alpha : 0.0;
+    header.calibrationHash = calibrationHash;
+    header.cameraModel = m_cameraModel;
+    std::memcpy(header.intrinsicMatrix, intrinsicMatrix.ptr<double>(), 9 * sizeof(double));
+    header.nbDistortionCoeffs = static_cast<int32_t>(distortionCoeffs.total());
+    if (header.nbDistortionCoeffs > 0)
+        std::memcpy(header.distortionCoeffs, distortionCoeffs.ptr<double>(), distortionCoeffs.total() * sizeof(double));
+    header.reprojectionError = m_reprojectionError;
+
+    // Written under a temporary name then renamed, so that another instance never maps a partially written file.
+    // The temporary name is unique among the instances of all the processes sharing the calibration folder.
+    MAPSString cachePath = GetRemapCachePath();
+    MAPSStreamedString tmpPath;
+    tmpPath << cachePath << "." << CurrentProcessId() << "_" << static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(this)) << ".tmp";
+
+    MAPSIconv::localeChar* tmp_locale = MAPSIconv::UTF8ToLocale(static_cast<const char*>(tmpPath));
+    MAPSIconv::localeChar* path_locale = MAPSIconv::UTF8ToLocale(static_cast<const char*>(cachePath));
+    bool written;
+    {
+        std::ofstream file(tmp_locale, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(m_undistMap1.data), m_undistMap1.total() * m_undistMap1.elemSize());
+        file.write(reinterpret_cast<const char*>(m_undistMap2.data), m_undistMap2.total() * m_undistMap2.elemSize());
+        written = static_cast<bool>(file);
+    }
+    if (written)
+    {
+        std::remove(path_locale);
+        written = std::rename(tmp_locale, path_locale) == 0;
+    }
+    if (!written)
+        std::remove(tmp_locale);
+    MAPSIconv::releaseLocale(path_locale);
+    MAPSIconv::releaseLocale(tmp_locale);
+
+    if (!written)
+    {
+        MAPSStreamedString sx;
+        ReportWarning(sx << "Failed to write the undistortion maps cache file [" << cachePath << "]");
+    }
+}
+
+MAPSOpenCV_Calibration::MappedFile::MappedFile()
+: data(nullptr)
+, size(0)
+#ifdef _WIN32
+, fileHandle(INVALID_HANDLE_VALUE)
+, mappingHandle(nullptr)
+#endif
+{
+}
+
+MAPSOpenCV_Calibration::MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MAPSOpenCV_Calibration::MappedFile::Open(const char* path)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = static_cast<const unsigned char*>(view);
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping stays valid after the descriptor is closed
+    if (view == MAP_FAILED)
+        return false;
+    data = static_cast<const unsigned char*>(view);
+    size = static_cast<size_t>(st.st_size);
+#endif
+    return true;
+}
+
+void MAPSOpenCV_Calibration::MappedFile::Close()
+{
+    if (data == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+// For the fisheye model, the alpha of the cropping modes is used as the balance between the focal lengths
+// that keep all the pixels (1) and only the valid ones (0).
+cv::Mat MAPSOpenCV_Calibration::ComputeNewCameraMatrix(const cv::Size& imageSize) const
+{
+    if (m_cameraModel == CameraModel_Fisheye)
+    {
+        double balance;
+        switch (m_undistMode)
+        {
+            case UNDIST_MODE_NO_CROPPING: balance = 1.0; break;
+            case UNDIST_MODE_CROPPING: balance = 0.0; break;
+            case UNDIST_MODE_CUSTOM: balance = m_alpha; break;
+            case UNDIST_MODE_DEFAULT:
+            default:
+                return m_intrinsicMatrix;
+        }
+        cv::Mat newMatrix;
+        cv::fisheye::estimateNewCameraMatrixForUndistortRectify(m_intrinsicMatrix, m_distortionCoeffs, imageSize, cv::Matx33d::eye(), newMatrix, balance, imageSize);
+        return newMatrix;
+    }
+
+    switch (m_undistMode)
+    {
+        case UNDIST_MODE_NO_CROPPING:
+            return cv::getOptimalNewCameraMatrix(m_intrinsicMatrix, m_distortionCoeffs, imageSize, 1.0, imageSize);
+        case UNDIST_MODE_CROPPING:
+            return cv::getOptimalNewCameraMatrix(m_intrinsicMatrix, m_distortionCoeffs, imageSize, 0.0, imageSize);
+        case UNDIST_MODE_CUSTOM:
+            return cv::getOptimalNewCameraMatrix(m_intrinsicMatrix, m_distortionCoeffs, imageSize, m_alpha);
+        case UNDIST_MODE_DEFAULT:
+        default:
+            return m_intrinsicMatrix;
+    }
+}
+
+// Undistortion maps for the current image size: mapped from the remap cache when there is a valid one (when allowed),
+// computed then saved in the cache otherwise.
+void MAPSOpenCV_Calibration::UpdateUndistortMaps(bool tryRemapCache)
+{
+    //The previous maps may point into the cache file mapping, which is closed by LoadRemapCache
+    m_undistMap1.release();
+    m_undistMap2.release();
+    if (m_useRemapCache && tryRemapCache && LoadRemapCache())
+        return;
+
+    ComputeUndistortMaps();
+    if (m_useRemapCache)
+        SaveRemapCache();
+}
+
+// The undistortion maps only depend on the calibration, the image size and the undistortion mode:
+// they are computed once, in fixed-point form (CV_16SC2) for a faster remap.
+void MAPSOpenCV_Calibration::ComputeUndistortMaps()
+{
+    if (m_stereo)
+    {
+        ComputeRectificationMaps();
+        return;
+    }
+
+    if (m_cameraModel == CameraModel_Fisheye)
+        cv::fisheye::initUndistortRectifyMap(m_intrinsicMatrix, m_distortionCoeffs, cv::Matx33d::eye(), ComputeNewCameraMatrix(m_imageSize), m_imageSize, CV_16SC2, m_undistMap1, m_undistMap2);
+    else
+        cv::initUndistortRectifyMap(m_intrinsicMatrix, m_distortionCoeffs, cv::Mat(), ComputeNewCameraMatrix(m_imageSize), m_imageSize, CV_16SC2, m_undistMap1, m_undistMap2);
+}
+
+// The rectification (hence the maps of both cameras) depends on the image size and on the cropping mode, so it is
+// computed from the stereo calibration rather than stored. alpha is the one of stereoRectify (-1 in Default mode).
+void MAPSOpenCV_Calibration::ComputeRectificationMaps()
+{
+    double alpha;
     switch (m_undistMode)
     {
+        case UNDIST_MODE_NO_CROPPING: alpha = 1.0; break;
+        case UNDIST_MODE_CROPPING: alpha = 0.0; break;
+        case UNDIST_MODE_CUSTOM: alpha = m_alpha; break;
         case UNDIST_MODE_DEFAULT:
-            cv::undistort(imageIn, imageOut, m_intrinsicMatrix, m_distortionCoeffs);
+        default:
+            alpha = -1.0;
             break;
-        case UNDIST_MODE_NO_CROPPING:
+    }
+
+    cv::stereoRectify(
+        m_intrinsicMatrix, m_distortionCoeffs,
+        m_intrinsicMatrixRight, m_distortionCoeffsRight,
+        m_imageSize, m_stereoRotation, m_stereoTranslation,
+        m_rectificationLeft, m_rectificationRight, m_projectionLeft, m_projectionRight, m_disparityToDepth,
+        cv::CALIB_ZERO_DISPARITY, alpha, m_imageSize
+    );
+
+    cv::initUndistortRectifyMap(m_intrinsicMatrix, m_distortionCoeffs, m_rectificationLeft, m_projectionLeft, m_imageSize, CV_16SC2, m_undistMap1, m_undistMap2);
+    cv::initUndistortRectifyMap(m_intrinsicMatrixRight, m_distortionCoeffsRight, m_rectificationRight, m_projectionRight, m_imageSize, CV_16SC2, m_rightMap1, m_rightMap2);
+}
+
+// The two images of the pair are remapped one after the other, each one using all the OpenCV threads, and output
+// with the timestamp of the pair.
+void MAPSOpenCV_Calibration::RectifyPair(MAPSTimestamp ts, const IplImage& leftIplImage, const IplImage& rightIplImage)
+{
+    MAPS::OutputGuard<IplImage> outGuardLeft{ this, Output(0) };
+    MAPS::OutputGuard<IplImage> outGuardRight{ this, *m_rightImageOutput };
+
+    const cv::Mat leftIn = convTools::noCopyIplImage2Mat(&leftIplImage);
+    const cv::Mat rightIn = convTools::noCopyIplImage2Mat(&rightIplImage);
+    cv::Mat leftOut = convTools::noCopyIplImage2Mat(&outGuardLeft.Data());
+    cv::Mat rightOut = convTools::noCopyIplImage2Mat(&outGuardRight.Data());
+
+    if (leftIn.size() != rightIn.size())
+        Error("The left and right images must have the same size.");
+    if (m_undistMap1.empty() || m_undistMap1.size() != leftIn.size())
+    {
+        m_imageSize = leftIn.size();
+        ComputeUndistortMaps();
+    }
+
+    //One image after the other: cv::remap already splits each image between the OpenCV threads, and it would only
+    //run on a single thread inside a parallel_for_ over both images.
+    cv::remap(leftIn, leftOut, m_undistMap1, m_undistMap2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    cv::remap(rightIn, rightOut, m_rightMap1, m_rightMap2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+
+    outGuardLeft.Timestamp() = ts;
+    outGuardLeft.VectorSize() = 0;
+    outGuardRight.Timestamp() = ts;
+    outGuardRight.VectorSize() = 0;
+}
+
+void MAPSOpenCV_Calibration::WriteDisparityToDepth(MAPSTimestamp ts)
+{
+    MAPS::OutputGuard<MAPSMatrix> outGuard{ this, *m_disparityToDepthOutput };
+    MAPSMatrix& q = outGuard.Data();
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int col = 0; col < 4; ++col)
         {
-            cv::Mat newMatrix = cv::getOptimalNewCameraMatrix(m_intrinsicMatrix, m_distortionCoeffs, imageIn.size(), 1.0, imageIn.size());
-            cv::undistort(imageIn, imageOut, m_intrinsicMatrix, m_distortionCoeffs, newMatrix);
-            break;
+            q.Real(row, col) = m_disparityToDepth.at<double>(row, col);
+            q.Im(row, col) = 0;
         }
-        case UNDIST_MODE_CROPPING:
+    }
+    outGuard.Timestamp() = ts;
+}
+
+// Undistorts m_distortedPoints into m_undistortedPoints, in the pixel coordinates of the undistorted image.
+// When no image has been received yet, the image size stored in the calibration file is used.
+void MAPSOpenCV_Calibration::UndistortPoints()
+{
+    m_undistortedPoints.clear();
+    if (m_distortedPoints.empty())
+        return;
+
+    const cv::Size imageSize = m_imageSize.area() > 0 ? m_imageSize : m_calibrationImageSize;
+    if (m_pointsNewMatrix.empty() || m_pointsNewMatrixSize != imageSize)
+    {
+        if (imageSize.area() == 0 && m_undistMode != UNDIST_MODE_DEFAULT)
+            Error("The image size is unknown (no image received and no image size in the calibration file): only the Default undistortion mode can be used.");
+        m_pointsNewMatrix = ComputeNewCameraMatrix(imageSize);
+        m_pointsNewMatrixSize = imageSize;
+    }
+
+    if (m_cameraModel == CameraModel_Fisheye)
+        cv::fisheye::undistortPoints(m_distortedPoints, m_undistortedPoints, m_intrinsicMatrix, m_distortionCoeffs, cv::noArray(), m_pointsNewMatrix);
+    else
+        cv::undistortPoints(m_distortedPoints, m_undistortedPoints, m_intrinsicMatrix, m_distortionCoeffs, cv::noArray(), m_pointsNewMatrix);
+}
+
+void MAPSOpenCV_Calibration::ProcessPoints(MAPSTimestamp ts, const MAPS::InputElt<>& inElt)
+{
+    int nbPoints = inElt.VectorSize() / 2;
+    if (nbPoints > m_maxPoints)
+    {
+        MAPSStreamedString sx;
+        ReportWarning(sx << "Received " << nbPoints << " points, only the first " << m_maxPoints << " are undistorted (see max_points).");
+        nbPoints = m_maxPoints;
+    }
+
+    m_distortedPoints.resize(nbPoints);
+    if (m_pointsInput == PointsInput_Integer32)
+    {
+        const MAPSInt32* coords = &inElt.DataAs<MAPSInt32>();
+        for (int i = 0; i < nbPoints; ++i)
+            m_distortedPoints[i] = cv::Point2f(static_cast<float>(coords[2 * i]), static_cast<float>(coords[2 * i + 1]));
+    }
+    else
+    {
+        const MAPSFloat32* coords = &inElt.DataAs<MAPSFloat32>();
+        for (int i = 0; i < nbPoints; ++i)
+            m_distortedPoints[i] = cv::Point2f(coords[2 * i], coords[2 * i + 1]);
+    }
+
+    UndistortPoints();
+
+    if (m_pointsInput == PointsInput_Integer32)
+    {
+        MAPS::OutputGuard<MAPSInt32> outGuard{ this, *m_pointsOutput };
+        for (int i = 0; i < nbPoints; ++i)
+        {
+            outGuard.Data(2 * i) = cvRound(m_undistortedPoints[i].x);
+            outGuard.Data(2 * i + 1) = cvRound(m_undistortedPoints[i].y);
+        }
+        outGuard.VectorSize() = 2 * nbPoints;
+        outGuard.Timestamp() = ts;
+    }
+    else
+    {
+        MAPS::OutputGuard<MAPSFloat32> outGuard{ this, *m_pointsOutput };
+        for (int i = 0; i < nbPoints; ++i)
         {
-            cv::Mat newMatrix = cv::getOptimalNewCameraMatrix(m_intrinsicMatrix, m_distortionCoeffs, imageIn.size(), 0.0, imageIn.size());
-            cv::undistort(imageIn, imageOut, m_intrinsicMatrix, m_distortionCoeffs, newMatrix);
+            outGuard.Data(2 * i) = m_undistortedPoints[i].x;
+            outGuard.Data(2 * i + 1) = m_undistortedPoints[i].y;
+        }
+        outGuard.VectorSize() = 2 * nbPoints;
+        outGuard.Timestamp() = ts;
+    }
+}
+
+// Rectangles are replaced by the bounding box of their 4 undistorted corners. Lines, spots, circles (center only)
+// and texts are moved, the other kinds of objects are copied as is.
+void MAPSOpenCV_Calibration::ProcessObjects(MAPSTimestamp ts, const MAPS::InputElt<>& inElt)
+{
+    int nbObjects = inElt.VectorSize();
+    if (nbObjects > m_maxObjects)
+    {
+        MAPSStreamedString sx;
+        ReportWarning(sx << "Received " << nbObjects << " objects, only the first " << m_maxObjects << " are undistorted (see max_objects).");
+        nbObjects = m_maxObjects;
+    }
+
+    const MAPSDrawingObject* objects = &inElt.DataAs<MAPSDrawingObject>();
+    m_distortedPoints.clear();
+    for (int i = 0; i < nbObjects; ++i)
+    {
+        const MAPSDrawingObject& obj = objects[i];
+        switch (obj.kind)
+        {
+        case MAPSDrawingObject::Rectangle:
+            m_distortedPoints.push_back(cv::Point2f(static_cast<float>(obj.rectangle.x1), static_cast<float>(obj.rectangle.y1)));
+            m_distortedPoints.push_back(cv::Point2f(static_cast<float>(obj.rectangle.x2), static_cast<float>(obj.rectangle.y1)));
+            m_distortedPoints.push_back(cv::Point2f(static_cast<float>(obj.rectangle.x2), static_cast<float>(obj.rectangle.y2)));
+            m_distortedPoints.push_back(cv::Point2f(static_cast<float>(obj.rectangle.x1), static_cast<float>(obj.rectangle.y2)));
+            break;
+        case MAPSDrawingObject::Line:
+            m_distortedPoints.push_back(cv::Point2f(static_cast<float>(obj.line.x1), static_cast<float>(obj.line.y1)));
+            m_distortedPoints.push_back(cv::Point2f(static_cast<float>(obj.line.x2), static_cast<float>(obj.line.y2)));
+            break;
+        case MAPSDrawingObject::Spot:
+            m_distortedPoints.push_back(cv::Point2f(static_cast<float>(obj.spot.x), static_cast<float>(obj.spot.y)));
+            break;
+        case MAPSDrawingObject::Circle:
+            m_distortedPoints.push_back(cv::Point2f(static_cast<float>(obj.circle.x), static_cast<float>(obj.circle.y)));
+            break;
+        case MAPSDrawingObject::Text:
+            m_distortedPoints.push_back(cv::Point2f(static_cast<float>(obj.text.x), static_cast<float>(obj.text.y)));
+            break;
+        default:
             break;
         }
-        case UNDIST_MODE_CUSTOM:
+    }
+
+    UndistortPoints();
+
+    MAPS::OutputGuard<MAPSDrawingObject> outGuard{ this, *m_objectsOutput };
+    const cv::Point2f* p = m_undistortedPoints.data();
+    for (int i = 0; i < nbObjects; ++i)
+    {
+        MAPSDrawingObject& obj = outGuard.Data(i);
+        obj = objects[i];
+        switch (obj.kind)
         {
-            cv::Mat newMatrix = cv::getOptimalNewCameraMatrix(m_intrinsicMatrix, m_distortionCoeffs, imageIn.size(), m_alpha);
-            cv::undistort(imageIn, imageOut, m_intrinsicMatrix, m_distortionCoeffs, newMatrix);
+        case MAPSDrawingObject::Rectangle:
+        {
+            const cv::Rect box = cv::boundingRect(std::vector<cv::Point2f>(p, p + 4));
+            obj.rectangle.x1 = box.x;
+            obj.rectangle.y1 = box.y;
+            obj.rectangle.x2 = box.x + box.width - 1;
+            obj.rectangle.y2 = box.y + box.height - 1;
+            p += 4;
+            break;
+        }
+        case MAPSDrawingObject::Line:
+            obj.line.x1 = cvRound(p[0].x);
+            obj.line.y1 = cvRound(p[0].y);
+            obj.line.x2 = cvRound(p[1].x);
+            obj.line.y2 = cvRound(p[1].y);
+            p += 2;
+            break;
+        case MAPSDrawingObject::Spot:
+            obj.spot.x = cvRound(p->x);
+            obj.spot.y = cvRound(p->y);
+            ++p;
+            break;
+        case MAPSDrawingObject::Circle:
+            obj.circle.x = cvRound(p->x);
+            obj.circle.y = cvRound(p->y);
+            ++p;
+            break;
+        case MAPSDrawingObject::Text:
+            obj.text.x = cvRound(p->x);
+            obj.text.y = cvRound(p->y);
+            ++p;
+            break;
+        default:
             break;
         }
     }
+    outGuard.VectorSize() = nbObjects;
+    outGuard.Timestamp() = ts;
+}
+
+void MAPSOpenCV_Calibration::UndistortImage(MAPSTimestamp ts, const IplImage& iplImageIn)
+{
+    cv::Mat imageIn = convTools::noCopyIplImage2Mat(&iplImageIn);
+    MAPS::OutputGuard<IplImage> outGuard{ this, Output(0) };
+    cv::Mat imageOut = convTools::noCopyIplImage2Mat(&outGuard.Data());
+
+    //First image after a calibration loaded from points or objects data (unknown image size), or new image size
+    if (m_undistMap1.empty() || m_undistMap1.size() != imageIn.size())
+    {
+        m_imageSize = imageIn.size();
+        UpdateUndistortMaps(true);
+    }
+    cv::remap(imageIn, imageOut, m_undistMap1, m_undistMap2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
 
     outGuard.Timestamp() = ts;
     outGuard.VectorSize() = 0;
@@ -618,9 +1686,12 @@ void MAPSOpenCV_Calibration::WriteCalibrationData(MAPSTimestamp ts)
         }
     }
 
+    //Fisheye calibrations only have 4 coefficients (k1..k4): the 5th one is then set to 0
+    const double* coeffs = m_distortionCoeffs.ptr<double>();
+    const int nbCoeffs = static_cast<int>(m_distortionCoeffs.total());
     for (int row = 0; row < 5; ++row)
     {
-        distortion.Real(row, 0) = m_distortionCoeffs.at<double>(row, 0);
+        distortion.Real(row, 0) = row < nbCoeffs ? coeffs[row] : 0.0;
         distortion.Im(row, 0) = 0;
     }
 
@@ -631,6 +1702,45 @@ void MAPSOpenCV_Calibration::WriteCalibrationData(MAPSTimestamp ts)
     outGuard3.Timestamp() = ts;
 }
 
+void MAPSOpenCV_Calibration::AllocateOutputBufferSize_Stereo(const MAPSTimestamp, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    const IplImage& leftImage = inElts[0].Data();
+    const IplImage& rightImage = inElts[1].Data();
+    if (leftImage.width != rightImage.width || leftImage.height != rightImage.height || leftImage.nChannels != rightImage.nChannels)
+        Error("The left and right images must have the same size and format.");
+
+    m_imageSize = cv::Size(leftImage.width, leftImage.height);
+    AllocateBuffers(leftImage);
+    m_rightImageOutput->AllocOutputBufferIplImage(rightImage);
+    m_disparityToDepthOutput->AllocOutputBufferMatrix(4, 4);
+}
+
+void MAPSOpenCV_Calibration::ProcessData_Stereo(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    try
+    {
+        if (m_operationMode == OperationMode_CalibSaveUndistort && !m_calibrated)
+        {
+            //The synchronized reader is reactive: the snapshots are taken every capture period
+            if (m_lastCaptureTs >= 0 && ts - m_lastCaptureTs < m_capturePeriodUs)
+                return;
+            m_lastCaptureTs = ts;
+            Core_Calibrate_Actual(ts, inElts[0].Data(), &inElts[1].Data());
+        }
+        else
+        {
+            LoadCalibration();
+            RectifyPair(ts, inElts[0].Data(), inElts[1].Data());
+            WriteCalibrationData(ts);
+            WriteDisparityToDepth(ts);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        Error(e.what());
+    }
+}
+
 void MAPSOpenCV_Calibration::AllocateOutputBufferSize_Triggered(const MAPSTimestamp, const MAPS::ArrayView<MAPS::InputElt<>> inElts)
 {
     const IplImage& imageIn = inElts[1].DataAs<IplImage>();
@@ -687,13 +1797,35 @@ void MAPSOpenCV_Calibration::ProcessData_Periodic(const MAPSTimestamp ts, MAPS::
     }
 }
 
-void MAPSOpenCV_Calibration::ProcessData_Reactive(const MAPSTimestamp ts, const MAPS::InputElt<IplImage> inElt)
+void MAPSOpenCV_Calibration::ProcessData_Reactive(const MAPSTimestamp ts, const size_t inputThatAnswered, const MAPS::ArrayView<MAPS::InputElt<>> inElts)
 {
     try
     {
+        const int input = static_cast<int>(inputThatAnswered);
+        if (input == m_imageInputIndex)
+        {
+            const IplImage& imageIn = inElts[inputThatAnswered].DataAs<IplImage>();
+            if (!m_imageBuffersAllocated)
+            {
+                m_imageSize = cv::Size(imageIn.width, imageIn.height);
+                AllocateBuffers(imageIn);
+                m_imageBuffersAllocated = true;
+            }
+
+            LoadCalibration();
+            UndistortImage(ts, imageIn);
+            WriteCalibrationData(ts);
+            return;
+        }
+
         LoadCalibration();
-        UndistortImage(ts, inElt.Data());
-        WriteCalibrationData(ts);
+        if (input == m_pointsInputIndex)
+            ProcessPoints(ts, inElts[inputThatAnswered]);
+        else if (input == m_objectsInputIndex)
+            ProcessObjects(ts, inElts[inputThatAnswered]);
+
+        if (!m_useImageInput)
+            WriteCalibrationData(ts);
     }
     catch (const std::exception& e)
     {
@@ -22,6 +22,26 @@
 
 // #define CLAMP(val, low, high) (((value) < (low))? (low): (((value) > (high))? high : value))
 
+int convTools::iplDepthToCvDepth(int iplDepth)
+{
+	switch (iplDepth)
+	{
+	case IPL_DEPTH_8U:  return CV_8U;
+	case IPL_DEPTH_8S:  return CV_8S;
+	case IPL_DEPTH_16U: return CV_16U;
+	case IPL_DEPTH_16S: return CV_16S;
+	case IPL_DEPTH_32S: return CV_32S;
+	case IPL_DEPTH_32F: return CV_32F;
+	case IPL_DEPTH_64F: return CV_64F;
+	default:
+	{
+		std::ostringstream s;
+		s << "Unsupported IplImage depth [" << iplDepth << "]. Cannot convert IplImage to cv::Mat";
+		throw std::domain_error(s.str());
+	}
+	}
+}
+
 template <typename IPL, typename MAT>
 MAT noCopy(IPL image)
 {
@@ -41,7 +61,7 @@ MAT noCopy(IPL image)
 	if (!image->roi)
 	{
 		return cv::Mat(static_cast<int>(image->height), static_cast<int>(image->width),
-                       CV_MAKETYPE(image->depth == 8 ? 0 : image->depth / 8, image->nChannels),
+                       CV_MAKETYPE(convTools::iplDepthToCvDepth(image->depth), image->nChannels),
                        image->imageData, image->widthStep);
 	}
 	else
@@ -87,7 +107,7 @@ MAT noCopy(IPL image)
 		}
 
 		cv::Mat shallowCopy = cv::Mat(static_cast<int>(image->height), static_cast<int>(image->width),
-                                      CV_MAKETYPE(image->depth == 8 ? 0 : image->depth / 8, image->nChannels),
+                                      CV_MAKETYPE(convTools::iplDepthToCvDepth(image->depth), image->nChannels),
 			image->imageData, image->widthStep);
 		return shallowCopy(cv::Range(image->roi->yOffset, lastRow),
 						   cv::Range(image->roi->xOffset, lastCol));
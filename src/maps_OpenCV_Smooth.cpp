@@ -64,7 +64,7 @@ MAPS_BEGIN_ACTIONS_DEFINITION(MAPSOpenCV_Smooth)
 MAPS_END_ACTIONS_DEFINITION
 
 // Use the macros to declare this component (OpenCV_Smooth) behaviour
-MAPS_COMPONENT_DEFINITION(MAPSOpenCV_Smooth, "OpenCV_Smooth", "2.1.1", 128,
+MAPS_COMPONENT_DEFINITION(MAPSOpenCV_Smooth, "OpenCV_Smooth", "2.2.0", 128,
                              MAPS::Threaded|MAPS::Sequential, MAPS::Threaded,
                              1, // Nb of inputs
                             -1, // Nb of outputs
@@ -294,10 +294,12 @@ void MAPSOpenCV_Smooth::AllocateOutputBufferSize(const MAPSTimestamp, const MAPS
 {
     const IplImage& imageIn = inElts[0].DataAs<IplImage>();
 
-    if (imageIn.nChannels != 1 && imageIn.nChannels != 3)
-        Error("This component only accepts images with 1 or 3 channels.");
-    if (imageIn.depth != 8)
-        Error("This component only accepts 8 bits depth images.");
+    if (imageIn.nChannels != 1 && imageIn.nChannels != 3 && imageIn.nChannels != 4)
+        Error("This component only accepts images with 1, 3 or 4 channels.");
+    if (imageIn.depth != IPL_DEPTH_8U && imageIn.depth != IPL_DEPTH_16U && imageIn.depth != IPL_DEPTH_32F)
+        Error("This component only accepts 8 bits, 16 bits unsigned or 32 bits float depth images.");
+    if (m_type == 2 && imageIn.depth != IPL_DEPTH_8U && m_param1 > 5)
+        Error("Median blur with a kernel size greater than 5 only accepts 8 bits depth images.");
     Output(0).AllocOutputBufferIplImage(imageIn);
     m_width = imageIn.width;
     m_height = imageIn.height;
@@ -349,7 +351,16 @@ void MAPSOpenCV_Smooth::ProcessIplImage(const IplImage& imageIn, IplImage& image
     m_tempImageOut = convTools::noCopyIplImage2Mat(&imageOut);
     cv::Rect region(0, 0, m_width, m_height);
 
-    std::memcpy(imageOut.imageData, imageIn.imageData, imageOut.imageSize);
+    if (m_useRoiInput == 0)
+    {
+        // No ROI input: the whole image is smoothed, no need to copy the input first.
+        SmoothRegion(m_tempImageIn, m_tempImageOut);
+    }
+    else
+    {
+        std::memcpy(imageOut.imageData, imageIn.imageData, imageOut.imageSize);
+    }
+
     for (size_t i = 0; i < m_vLastRois.size(); i++)
     {
         int offset = m_vLastRois[i].yOffset * m_vLastRois[i].width + m_vLastRois[i].xOffset;
@@ -359,34 +370,88 @@ void MAPSOpenCV_Smooth::ProcessIplImage(const IplImage& imageIn, IplImage& image
 
         region = cv::Rect(m_vLastRois[i].xOffset, m_vLastRois[i].yOffset, m_vLastRois[i].width, m_vLastRois[i].height);
 
-        try
-        {
-            switch (m_type)
-            {
-                case 0:
-                    cv::blur(m_tempImageIn(region), m_tempImageOut(region), cv::Size(m_param1, m_param2));
-                break;
-                case 1:
-                    cv::GaussianBlur(m_tempImageIn(region), m_tempImageOut(region), cv::Size(m_param1, m_param2), m_param3, m_param4);
-                break;
-                case 2:
-                    cv::medianBlur(m_tempImageIn(region), m_tempImageOut(region), m_param1);
-                break;
-                case 3:
-                    cv::bilateralFilter(m_tempImageIn(region), m_tempImageOut(region), -1, m_param1, m_param2);
-                break;
-            }
-        }
-        catch (const std::exception& e)
-        {
-            Error(e.what());
-        }
+        cv::Mat regionOut = m_tempImageOut(region);
+        SmoothRegion(m_tempImageIn(region), regionOut);
     }
 
     if (static_cast<void*>(m_tempImageOut.data) != static_cast<void*>(imageOut.imageData)) // if the ptr are different then opencv reallocated memory for the cv::Mat
         Error("cv::Mat data ptr and imageOut data ptr are different.");
 }
 
+void MAPSOpenCV_Smooth::SmoothRegion(const cv::Mat& src, cv::Mat& dst)
+{
+    // blur, GaussianBlur and medianBlur work natively (vectorized) on 8U, 16U and 32F images with 1, 3 or 4 channels.
+    try
+    {
+        switch (m_type)
+        {
+            case 0:
+                cv::blur(src, dst, cv::Size(m_param1, m_param2));
+            break;
+            case 1:
+                cv::GaussianBlur(src, dst, cv::Size(m_param1, m_param2), m_param3, m_param4);
+            break;
+            case 2:
+                cv::medianBlur(src, dst, m_param1);
+            break;
+            case 3:
+                BilateralFilter(src, dst);
+            break;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        Error(e.what());
+    }
+}
+
+void MAPSOpenCV_Smooth::BilateralFilter(const cv::Mat& src, cv::Mat& dst)
+{
+    const bool hasAlpha = src.channels() == 4;
+    const bool toFloat = src.depth() == CV_16U;
+
+    if (!hasAlpha && !toFloat)
+    {
+        cv::bilateralFilter(src, dst, -1, m_param1, m_param2);
+        return;
+    }
+
+    // cv::bilateralFilter only handles 8U or 32F images with 1 or 3 channels:
+    // drop the alpha channel and filter 16U images as floats (same intensity scale, so color_sigma keeps its meaning).
+    cv::Mat filterIn = src;
+    if (hasAlpha)
+    {
+        cv::cvtColor(filterIn, m_bilateralColor, cv::COLOR_BGRA2BGR);
+        filterIn = m_bilateralColor;
+    }
+    if (toFloat)
+    {
+        filterIn.convertTo(m_bilateralIn, CV_32F);
+        filterIn = m_bilateralIn;
+    }
+
+    cv::bilateralFilter(filterIn, m_bilateralOut, -1, m_param1, m_param2);
+
+    cv::Mat filterOut = m_bilateralOut;
+    if (toFloat)
+    {
+        m_bilateralOut.convertTo(m_bilateralColor, src.depth());
+        filterOut = m_bilateralColor;
+    }
+
+    if (hasAlpha)
+    {
+        // Filtered color channels from filterOut, alpha channel (index 3 + 3 in the concatenated sources) unchanged from src.
+        const cv::Mat sources[] = { filterOut, src };
+        const int fromTo[] = { 0, 0, 1, 1, 2, 2, 6, 3 };
+        cv::mixChannels(sources, 2, &dst, 1, fromTo, 4);
+    }
+    else
+    {
+        filterOut.copyTo(dst);
+    }
+}
+
 void MAPSOpenCV_Smooth::ProcessRoi(const MAPS::InputElt<>& Elt)
 {
     switch (m_useRoiInput)
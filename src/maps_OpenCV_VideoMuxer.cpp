@@ -27,6 +27,7 @@
 ////////////////////////////////
 
 #include "maps_OpenCV_VideoMuxer.h" // Includes the header of this component
+#include <opencv2/core/hal/intrin.hpp>
 
 // Use the macros to declare the inputs
 MAPS_BEGIN_INPUTS_DEFINITION(MAPSOpenCV_VideoMuxer)
@@ -42,7 +43,7 @@ MAPS_END_OUTPUTS_DEFINITION
 // Use the macros to declare the properties
 MAPS_BEGIN_PROPERTIES_DEFINITION(MAPSOpenCV_VideoMuxer)
     MAPS_PROPERTY("nb_inputs", 2, false, false)
-    MAPS_PROPERTY_ENUM("sampling_mode", "Triggered|Synchronized|Asynchronous (update at each img recv)", 0, false, false)
+    MAPS_PROPERTY_ENUM("sampling_mode", "Triggered|Synchronized|Asynchronous (update at each img recv)|Periodic (fixed output rate)", 0, false, false)
     MAPS_PROPERTY_ENUM("trigger_input", "None", 0, false, false)
     MAPS_PROPERTY("synchro_tolerance", 0, false, false)
     MAPS_PROPERTY("out_image_width", -1, false, false)
@@ -54,6 +55,8 @@ MAPS_BEGIN_PROPERTIES_DEFINITION(MAPSOpenCV_VideoMuxer)
     MAPS_PROPERTY("height", -1, false, true)
     MAPS_PROPERTY("z_order", -1, false, true)
     MAPS_PROPERTY_END_SUBSECTION("subsection_end_opened", true)
+    MAPS_PROPERTY("output_period_ms", 40, false, false)
+    MAPS_PROPERTY_ENUM("out_color_format", "Same as first input|GRAY|RGB|BGR|RGBA|BGRA", 0, false, false)
 MAPS_END_PROPERTIES_DEFINITION
 
 // Use the macros to declare the actions
@@ -62,7 +65,7 @@ MAPS_BEGIN_ACTIONS_DEFINITION(MAPSOpenCV_VideoMuxer)
 MAPS_END_ACTIONS_DEFINITION
 
 // Use the macros to declare this component (OpenCV_VideoMuxer) behaviour
-MAPS_COMPONENT_DEFINITION(MAPSOpenCV_VideoMuxer, "OpenCV_VideoMuxer", "2.0.3", 128,
+MAPS_COMPONENT_DEFINITION(MAPSOpenCV_VideoMuxer, "OpenCV_VideoMuxer", "2.6.2", 128,
                              MAPS::Sequential | MAPS::Threaded, MAPS::Threaded,
                              0, // Nb of inputs
                             -1, // Nb of outputs
@@ -73,7 +76,8 @@ enum ReaderMode : uint8_t
 {
     ReaderMode_Triggered,
     ReaderMode_Synchronized,
-    ReaderMode_Async
+    ReaderMode_Async,
+    ReaderMode_Periodic
 };
 
 enum Property : uint8_t
@@ -97,15 +101,19 @@ void MAPSOpenCV_VideoMuxer::Dynamic()
     {
     case ReaderMode_Triggered:
         NewProperty("trigger_input");
-        m_firstPositionPropRuntime = 5;
+        m_firstPositionPropRuntime = 6;
         m_trigger = static_cast<int>(GetIntegerProperty("trigger_input"));
         break;
     case ReaderMode_Synchronized:
         NewProperty("synchro_tolerance");
-        m_firstPositionPropRuntime = 5;
+        m_firstPositionPropRuntime = 6;
         break;
     case ReaderMode_Async:
-        m_firstPositionPropRuntime = 4;
+        m_firstPositionPropRuntime = 5;
+        break;
+    case ReaderMode_Periodic:
+        NewProperty("output_period_ms");
+        m_firstPositionPropRuntime = 6;
         break;
     default:
         Error("Reader mode not supported");
@@ -114,6 +122,7 @@ void MAPSOpenCV_VideoMuxer::Dynamic()
 
     NewProperty("out_image_width");
     NewProperty("out_image_height");
+    NewProperty("out_color_format");
 
     //Store the current status of the trigger_input prop.
     MAPSEnumStruct trigger_enum;
@@ -143,6 +152,9 @@ void MAPSOpenCV_VideoMuxer::Dynamic()
         case ReaderMode_Async:
             m_inputs.push_back(&NewInput(0, iname));
             break;
+        case ReaderMode_Periodic:
+            m_inputs.push_back(&NewInput(1, iname));
+            break;
         }
 
         MAPSStreamedString im_name, im_pretty_name, xpos_name, ypos_name, width_name, height_name, z_o_name, end_sub_name;
@@ -188,11 +200,21 @@ void MAPSOpenCV_VideoMuxer::Birth()
     m_height.resize(m_nbInputs);
     m_zOrder.resize(m_nbInputs);
     m_ioeltsOrder.resize(m_nbInputs);
+    m_resizedImages.clear();
+    m_resizedImages.resize(m_nbInputs);
+    m_convertedImages.clear();
+    m_convertedImages.resize(m_nbInputs);
+    m_outColorFormat = static_cast<int>(GetIntegerProperty("out_color_format"));
+    m_inputFrames.assign(m_nbInputs, 0);
+    m_resizePlans.clear();
+    m_resizePlans.resize(m_nbInputs);
+    m_composeJobs.reserve(m_nbInputs);
+    m_levelJobs.reserve(m_nbInputs);
     m_firstTimeAllInit = true;
     m_outputInitialized = false;
     m_outmWidth = static_cast<int>(GetIntegerProperty("out_image_width"));
     m_outmHeight = static_cast<int>(GetIntegerProperty("out_image_height"));
-    m_bgInitialized.clear();
+    m_canvasValid = false;
 
     for (int i = 0; i < m_nbInputs; i++)
     {
@@ -248,10 +270,21 @@ void MAPSOpenCV_VideoMuxer::Birth()
             MAPS::InputReaderOption::Reactive::Buffering::Enabled,
             m_inputs,
             &MAPSOpenCV_VideoMuxer::Initialization_Reactive,
-            &MAPSOpenCV_VideoMuxer::ProcessData_Reactive
+            &MAPSOpenCV_VideoMuxer::ProcessData_Async
+        );
+        break;
+    case ReaderMode_Periodic:
+        m_lastSampledData.assign(m_nbInputs, nullptr);
+        m_lastSampledTs.assign(m_nbInputs, -1);
+        m_inputReader = MAPS::MakeInputReader::PeriodicSampling(
+            this,
+            static_cast<MAPSDelay>(GetIntegerProperty("output_period_ms") * 1000),
+            MAPS::InputReaderOption::PeriodicSampling::SamplingBehavior::WaitForAllInputs,
+            m_inputs,
+            &MAPSOpenCV_VideoMuxer::Initialization,
+            &MAPSOpenCV_VideoMuxer::ProcessData_Periodic
         );
         break;
-    case 3:
     default:
         Error("Unknown sampling mode");
     }
@@ -272,6 +305,290 @@ int compare_sortingelts(SortingElt* t1, SortingElt* t2)
     return t1->zorder - t2->zorder;
 }
 
+static inline uchar Div255(unsigned int t)
+{
+    t += 128;
+    return static_cast<uchar>((t + (t >> 8)) >> 8);
+}
+
+// "Over" compositing of a straight alpha BGRA/RGBA row onto the output row: dst = src * a + dst * (1 - a),
+// the output alpha becomes a + dst_a * (1 - a) (i.e. the source alpha channel is blended as if it were 255).
+static void AlphaBlendRow_8u(const uchar* src, uchar* dst, int width)
+{
+    int x = 0;
+#if CV_SIMD128
+    const cv::v_uint16x8 v_255 = cv::v_setall_u16(255);
+    const cv::v_uint16x8 v_128 = cv::v_setall_u16(128);
+    const cv::v_uint32x4 v_alphaMask = cv::v_setall_u32(0xFF000000);
+    for (; x <= width - 4; x += 4) // 4 pixels per iteration
+    {
+        cv::v_uint32x4 s = cv::v_reinterpret_as_u32(cv::v_load(src + 4 * x));
+        cv::v_uint32x4 a = cv::v_shr<24>(s);
+        a = a | cv::v_shl<8>(a);
+        a = a | cv::v_shl<16>(a); // alpha broadcast to the 4 channels of each pixel
+
+        cv::v_uint16x8 sLo, sHi, dLo, dHi, aLo, aHi;
+        cv::v_expand(cv::v_reinterpret_as_u8(s | v_alphaMask), sLo, sHi);
+        cv::v_expand(cv::v_load(dst + 4 * x), dLo, dHi);
+        cv::v_expand(cv::v_reinterpret_as_u8(a), aLo, aHi);
+
+        cv::v_uint16x8 tLo = cv::v_mul_wrap(sLo, aLo) + cv::v_mul_wrap(dLo, v_255 - aLo) + v_128;
+        cv::v_uint16x8 tHi = cv::v_mul_wrap(sHi, aHi) + cv::v_mul_wrap(dHi, v_255 - aHi) + v_128;
+        tLo = cv::v_shr<8>(tLo + cv::v_shr<8>(tLo));
+        tHi = cv::v_shr<8>(tHi + cv::v_shr<8>(tHi));
+        cv::v_store(dst + 4 * x, cv::v_pack(tLo, tHi));
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        const uchar* s = src + 4 * x;
+        uchar* d = dst + 4 * x;
+        const unsigned int a = s[3];
+        d[0] = Div255(s[0] * a + d[0] * (255 - a));
+        d[1] = Div255(s[1] * a + d[1] * (255 - a));
+        d[2] = Div255(s[2] * a + d[2] * (255 - a));
+        d[3] = Div255(255 * a + d[3] * (255 - a));
+    }
+}
+
+static void AlphaBlendRow_16u(const ushort* src, ushort* dst, int width)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        const ushort* s = src + 4 * x;
+        ushort* d = dst + 4 * x;
+        const unsigned int a = s[3];
+        d[0] = static_cast<ushort>((s[0] * a + d[0] * (65535 - a) + 32767) / 65535);
+        d[1] = static_cast<ushort>((s[1] * a + d[1] * (65535 - a) + 32767) / 65535);
+        d[2] = static_cast<ushort>((s[2] * a + d[2] * (65535 - a) + 32767) / 65535);
+        d[3] = static_cast<ushort>((65535 * a + d[3] * (65535 - a) + 32767) / 65535);
+    }
+}
+
+// Blends a 4 channels image onto a same size region of the output image, in place.
+static void AlphaBlend(const cv::Mat& src, cv::Mat& dst)
+{
+    CV_Assert(src.size() == dst.size() && src.type() == dst.type() && src.channels() == 4);
+    for (int y = 0; y < src.rows; ++y)
+    {
+        if (src.depth() == CV_8U)
+            AlphaBlendRow_8u(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols);
+        else if (src.depth() == CV_16U)
+            AlphaBlendRow_16u(src.ptr<ushort>(y), dst.ptr<ushort>(y), src.cols);
+        else
+            CV_Error(cv::Error::StsUnsupportedFormat, "Alpha blending only supports 8 or 16 bits images.");
+    }
+}
+
+#if CV_SIMD128
+// Sums neighbour values two by two: the 16 values of a then b give 8 sums.
+static inline cv::v_uint16x8 SumPairs(const cv::v_uint16x8& a, const cv::v_uint16x8& b)
+{
+    const cv::v_uint32x4 mask = cv::v_setall_u32(0xFFFF);
+    const cv::v_uint32x4 wa = cv::v_reinterpret_as_u32(a);
+    const cv::v_uint32x4 wb = cv::v_reinterpret_as_u32(b);
+    return cv::v_pack((wa & mask) + (wa >> 16), (wb & mask) + (wb >> 16));
+}
+#endif
+
+// Box filter downscaling by an integer factor (2 or 4): each output pixel is the rounded mean of a factor x factor block
+// of input pixels. rowSum is a buffer kept from one frame to the next.
+static void BoxDecimate(const cv::Mat& src, cv::Mat& dst, int factor, std::vector<ushort>& rowSum)
+{
+    CV_Assert((factor == 2 || factor == 4) && src.type() == dst.type()
+        && src.cols == dst.cols * factor && src.rows == dst.rows * factor);
+    if (src.depth() != CV_8U)
+    {
+        // Integer ratios are handled by the fast path of the area interpolation.
+        cv::resize(src, dst, dst.size(), 0, 0, cv::INTER_AREA);
+        return;
+    }
+
+    const int cn = src.channels();
+    const int srcWidth = src.cols * cn;
+    const int dstWidth = dst.cols * cn;
+    const int shift = factor == 2 ? 2 : 4; // division by factor * factor
+    rowSum.resize(srcWidth);
+    ushort* sum = rowSum.data();
+
+    for (int y = 0; y < dst.rows; y++)
+    {
+        // Vertical sums of the factor input rows.
+        int x = 0;
+#if CV_SIMD128
+        for (; x <= srcWidth - 16; x += 16)
+        {
+            cv::v_uint16x8 lo, hi;
+            cv::v_expand(cv::v_load(src.ptr<uchar>(y * factor) + x), lo, hi);
+            for (int k = 1; k < factor; k++)
+            {
+                cv::v_uint16x8 lo2, hi2;
+                cv::v_expand(cv::v_load(src.ptr<uchar>(y * factor + k) + x), lo2, hi2);
+                lo = lo + lo2;
+                hi = hi + hi2;
+            }
+            cv::v_store(sum + x, lo);
+            cv::v_store(sum + x + 8, hi);
+        }
+#endif
+        for (; x < srcWidth; x++)
+        {
+            unsigned int v = 0;
+            for (int k = 0; k < factor; k++)
+                v += src.ptr<uchar>(y * factor + k)[x];
+            sum[x] = static_cast<ushort>(v);
+        }
+
+        // Horizontal sums and rounded mean, 8 output values per iteration.
+        uchar* d = dst.ptr<uchar>(y);
+        x = 0;
+#if CV_SIMD128
+        if (cn == 1 && factor == 2)
+        {
+            for (; x <= dstWidth - 8; x += 8)
+            {
+                cv::v_uint16x8 a, b;
+                cv::v_load_deinterleave(sum + 2 * x, a, b);
+                cv::v_rshr_pack_store<2>(d + x, a + b);
+            }
+        }
+        else if (cn == 1 && factor == 4)
+        {
+            for (; x <= dstWidth - 8; x += 8)
+            {
+                cv::v_uint16x8 a, b, c, e;
+                cv::v_load_deinterleave(sum + 4 * x, a, b, c, e);
+                cv::v_rshr_pack_store<4>(d + x, (a + b) + (c + e));
+            }
+        }
+        else if (cn == 4)
+        {
+            // A 64 bits half of a vector holds one 4 channels pixel: adding the low and high halves of
+            // two vectors sums pairs of neighbour pixels.
+            for (; x <= dstWidth - 8; x += 8)
+            {
+                const ushort* s = sum + factor * x;
+                cv::v_uint32x4 a = cv::v_reinterpret_as_u32(cv::v_load(s));
+                cv::v_uint32x4 b = cv::v_reinterpret_as_u32(cv::v_load(s + 8));
+                cv::v_uint16x8 pairs = cv::v_reinterpret_as_u16(cv::v_combine_low(a, b)) + cv::v_reinterpret_as_u16(cv::v_combine_high(a, b));
+                if (factor == 2)
+                {
+                    cv::v_rshr_pack_store<2>(d + x, pairs);
+                }
+                else
+                {
+                    cv::v_uint32x4 c = cv::v_reinterpret_as_u32(cv::v_load(s + 16));
+                    cv::v_uint32x4 e = cv::v_reinterpret_as_u32(cv::v_load(s + 24));
+                    cv::v_uint16x8 pairs2 = cv::v_reinterpret_as_u16(cv::v_combine_low(c, e)) + cv::v_reinterpret_as_u16(cv::v_combine_high(c, e));
+                    cv::v_uint32x4 p = cv::v_reinterpret_as_u32(pairs);
+                    cv::v_uint32x4 p2 = cv::v_reinterpret_as_u32(pairs2);
+                    cv::v_rshr_pack_store<4>(d + x, cv::v_reinterpret_as_u16(cv::v_combine_low(p, p2)) + cv::v_reinterpret_as_u16(cv::v_combine_high(p, p2)));
+                }
+            }
+        }
+        else if (cn == 3)
+        {
+            // Deinterleave blocks of 8 pixels into one vector per channel, then sum neighbour pixels two by two
+            // (twice for a factor 4). 16 output pixels per iteration.
+            for (; x <= dstWidth - 48; x += 48)
+            {
+                cv::v_uint16x8 res[3][2];
+                for (int h = 0; h < 2; h++)
+                {
+                    const ushort* s = sum + factor * (x + h * 24);
+                    cv::v_uint16x8 blocks[3][4];
+                    for (int b = 0; b < factor; b++)
+                        cv::v_load_deinterleave(s + b * 24, blocks[0][b], blocks[1][b], blocks[2][b]);
+                    for (int c = 0; c < 3; c++)
+                    {
+                        res[c][h] = SumPairs(blocks[c][0], blocks[c][1]);
+                        if (factor == 4)
+                            res[c][h] = SumPairs(res[c][h], SumPairs(blocks[c][2], blocks[c][3]));
+                    }
+                }
+                if (factor == 2)
+                    cv::v_store_interleave(d + x, cv::v_rshr_pack<2>(res[0][0], res[0][1]), cv::v_rshr_pack<2>(res[1][0], res[1][1]), cv::v_rshr_pack<2>(res[2][0], res[2][1]));
+                else
+                    cv::v_store_interleave(d + x, cv::v_rshr_pack<4>(res[0][0], res[0][1]), cv::v_rshr_pack<4>(res[1][0], res[1][1]), cv::v_rshr_pack<4>(res[2][0], res[2][1]));
+            }
+        }
+#endif
+        for (; x < dstWidth; x++)
+        {
+            const int px = x / cn;
+            const int c = x - px * cn;
+            unsigned int v = 0;
+            for (int k = 0; k < factor; k++)
+                v += sum[(px * factor + k) * cn + c];
+            d[x] = static_cast<uchar>((v + (1 << (shift - 1))) >> shift);
+        }
+    }
+}
+
+static bool IsConvertibleFormat(MAPSUInt32 chanSeq)
+{
+    return chanSeq == MAPS_CHANNELSEQ_GRAY || chanSeq == MAPS_CHANNELSEQ_RGB || chanSeq == MAPS_CHANNELSEQ_BGR
+        || chanSeq == MAPS_CHANNELSEQ_RGBA || chanSeq == MAPS_CHANNELSEQ_BGRA;
+}
+
+// Returns the cv::cvtColor code converting an input image to the output format, -1 if there is nothing to convert.
+static int GetColorConversionCode(MAPSUInt32 from, MAPSUInt32 to)
+{
+    if (from == to)
+        return -1;
+
+    switch (from)
+    {
+    case MAPS_CHANNELSEQ_GRAY:
+        switch (to)
+        {
+        case MAPS_CHANNELSEQ_RGB: return cv::COLOR_GRAY2RGB;
+        case MAPS_CHANNELSEQ_BGR: return cv::COLOR_GRAY2BGR;
+        case MAPS_CHANNELSEQ_RGBA: return cv::COLOR_GRAY2RGBA;
+        case MAPS_CHANNELSEQ_BGRA: return cv::COLOR_GRAY2BGRA;
+        }
+        break;
+    case MAPS_CHANNELSEQ_RGB:
+        switch (to)
+        {
+        case MAPS_CHANNELSEQ_GRAY: return cv::COLOR_RGB2GRAY;
+        case MAPS_CHANNELSEQ_BGR: return cv::COLOR_RGB2BGR;
+        case MAPS_CHANNELSEQ_RGBA: return cv::COLOR_RGB2RGBA;
+        case MAPS_CHANNELSEQ_BGRA: return cv::COLOR_RGB2BGRA;
+        }
+        break;
+    case MAPS_CHANNELSEQ_BGR:
+        switch (to)
+        {
+        case MAPS_CHANNELSEQ_GRAY: return cv::COLOR_BGR2GRAY;
+        case MAPS_CHANNELSEQ_RGB: return cv::COLOR_BGR2RGB;
+        case MAPS_CHANNELSEQ_RGBA: return cv::COLOR_BGR2RGBA;
+        case MAPS_CHANNELSEQ_BGRA: return cv::COLOR_BGR2BGRA;
+        }
+        break;
+    case MAPS_CHANNELSEQ_RGBA:
+        switch (to)
+        {
+        case MAPS_CHANNELSEQ_GRAY: return cv::COLOR_RGBA2GRAY;
+        case MAPS_CHANNELSEQ_RGB: return cv::COLOR_RGBA2RGB;
+        case MAPS_CHANNELSEQ_BGR: return cv::COLOR_RGBA2BGR;
+        case MAPS_CHANNELSEQ_BGRA: return cv::COLOR_RGBA2BGRA;
+        }
+        break;
+    case MAPS_CHANNELSEQ_BGRA:
+        switch (to)
+        {
+        case MAPS_CHANNELSEQ_GRAY: return cv::COLOR_BGRA2GRAY;
+        case MAPS_CHANNELSEQ_RGB: return cv::COLOR_BGRA2RGB;
+        case MAPS_CHANNELSEQ_BGR: return cv::COLOR_BGRA2BGR;
+        case MAPS_CHANNELSEQ_RGBA: return cv::COLOR_BGRA2RGBA;
+        }
+        break;
+    }
+    CV_Error(cv::Error::StsUnsupportedFormat, "Unsupported image format conversion.");
+    return -1;
+}
+
 void MAPSOpenCV_VideoMuxer::ComputeSizesAndAllocOutBuffer()
 {
     //Alloc output buffer.
@@ -314,70 +631,178 @@ void MAPSOpenCV_VideoMuxer::ComputeSizesAndAllocOutBuffer()
         m_outmHeight = m_totalmHeight;
     }
 
-    m_outNeedResize = (m_outmWidth != m_totalmWidth) || (m_outmHeight != m_totalmHeight);
-    if (m_outNeedResize)
-    {
-        m_tempImage = MAPS::IplImageModel(m_totalmWidth, m_totalmHeight, *reinterpret_cast<MAPSUInt32*>(&m_chanSeq), m_dataOrder, m_depth, m_align);
-        m_tempImageData.reserve(m_tempImage.imageSize);
-        m_tempImage.imageData = m_tempImageData.data();
-
-        m_tempImage.roi = &m_tempROI;
-
-        MAPS::Memset(m_tempImage.imageData, 0, m_tempImage.imageSize);
-        MAPS::Memset(m_tempImage.roi, 0, sizeof(IplROI));
-        m_tempImage.roi->width = m_tempImage.width;
-        m_tempImage.roi->height = m_tempImage.height;
-    }
-
     IplImage model = MAPS::IplImageModel(m_outmWidth, m_outmHeight, *reinterpret_cast<MAPSUInt32*>(&m_chanSeq), m_dataOrder, m_depth, m_align);
     Output(0).AllocOutputBufferIplImage(model);
-    m_black = cv::Mat(cv::Mat::zeros(cv::Size(m_totalmWidth, m_totalmHeight), CV_MAKETYPE(m_depth, model.nChannels)));
+    m_canvas.create(cv::Size(m_outmWidth, m_outmHeight), CV_MAKETYPE(convTools::iplDepthToCvDepth(m_depth), model.nChannels));
+    m_canvasValid = false;
     m_outputInitialized = true;
 }
 
-void MAPSOpenCV_VideoMuxer::BackgroundInitialization(IplImage* imageOut)
+void MAPSOpenCV_VideoMuxer::ResetCanvas()
+{
+    //First output, or the layout changed: nothing from the inputs is in the canvas, let's set it to black.
+    m_canvas.setTo(cv::Scalar::all(0));
+    m_drawnFrames.assign(m_nbInputs, -1);
+    m_canvasValid = true;
+}
+
+bool MAPSOpenCV_VideoMuxer::ComputeInputPlacement(int i, int image_index, const cv::Size& sizeIn, cv::Rect& srcRect, cv::Rect& dstRect)
 {
-    if (m_outNeedResize)
+    int pos_x = m_posX[image_index];
+    int pos_y = m_posY[image_index];
+    int width = m_width[image_index];
+    if (width == -1)
+    {
+        width = sizeIn.width;
+    }
+    else if (width <= 0)
     {
-        imageOut = &m_tempImage;
+        ReportWarning("Image N width should be positive or -1 for auto");
+        return false;
     }
 
-    const std::lock_guard<std::mutex> lock(m_zorderMutex);
-    //Did we already encounter this ioEltOut ?
-    if (std::find(m_bgInitialized.begin(), m_bgInitialized.end(), imageOut->imageData) == m_bgInitialized.end())
+    int height = m_height[image_index];
+    if (height == -1)
     {
-        //This is the first time we will write something in this output image.
-        //Let's set the background to black...
-        cv::copyTo(m_black, convTools::noCopyIplImage2Mat(imageOut), cv::noArray());
+        height = sizeIn.height;
+    }
+    else if (height <= 0)
+    {
+        ReportWarning("Image N height should be positive or -1 for auto");
+        return false;
+    }
 
-        //... and make sure we will not do that again. Once is enough.
-        m_bgInitialized.push_back(imageOut->imageData);
+    if (pos_x > m_totalmWidth || pos_y > m_totalmHeight)
+    {
+        MAPSStreamedString s;
+        s << "Input image [" << i << "] out of bounds of output image. Please check left and top properties.";
+        ReportWarning(s);
+        return false;
     }
+    if ((pos_x + width < 0) || (pos_y + height) < 0)
+    {
+        MAPSStreamedString s;
+        s << "Input image [" << i << "] out of bounds of output image. Please check left, top, width and height properties.";
+        ReportWarning(s);
+        return false;
+    }
+
+    // Destination rectangle in output image coordinates: positions and sizes are given in the composed
+    // image space, which is scaled to out_image_width x out_image_height.
+    const double scale_x = static_cast<double>(m_outmWidth) / m_totalmWidth;
+    const double scale_y = static_cast<double>(m_outmHeight) / m_totalmHeight;
+    const int x0 = cvRound(pos_x * scale_x);
+    const int y0 = cvRound(pos_y * scale_y);
+    const int full_width = cvRound((pos_x + width) * scale_x) - x0;
+    const int full_height = cvRound((pos_y + height) * scale_y) - y0;
+    if (full_width <= 0 || full_height <= 0)
+        return false;
+
+    // Clip it to the output image, and crop the input image accordingly.
+    dstRect = cv::Rect(x0, y0, full_width, full_height) & cv::Rect(0, 0, m_outmWidth, m_outmHeight);
+    if (dstRect.area() <= 0)
+        return false;
+
+    srcRect.x = (dstRect.x - x0) * sizeIn.width / full_width;
+    srcRect.y = (dstRect.y - y0) * sizeIn.height / full_height;
+    srcRect.width = (dstRect.x + dstRect.width - x0) * sizeIn.width / full_width - srcRect.x;
+    srcRect.height = (dstRect.y + dstRect.height - y0) * sizeIn.height / full_height - srcRect.y;
+
+    return srcRect.area() > 0;
 }
 
-void MAPSOpenCV_VideoMuxer::OutputResultImage(MAPSTimestamp t, const MAPS::ArrayView<MAPS::InputElt<IplImage>>& inElts)
+void MAPSOpenCV_VideoMuxer::ResizeInput(const ComposeJob& job, const cv::Mat& src, cv::Mat& dst, cv::Size size)
 {
-    if (!m_outputInitialized)
-        return;
-    MAPS::OutputGuard<IplImage> outGuard{ this, Output(0) };
-    IplImage& imageOut = outGuard.Data(); // Convert IplImage to cv::Mat without copying
-    outGuard.Timestamp() = t;
+    ResizePlan& plan = m_resizePlans[job.index];
+    if (plan.decimation > 1)
+    {
+        dst.create(size, src.type()); // no-op when dst is the output image ROI
+        BoxDecimate(src, dst, plan.decimation, plan.rowSum);
+    }
+    else
+    {
+        cv::resize(src, dst, size);
+    }
+}
 
-    BackgroundInitialization(&imageOut);
+void MAPSOpenCV_VideoMuxer::ComposeInput(const ComposeJob& job, cv::Mat& dst)
+{
+    const bool resize = job.src.size() != dst.size();
+    const bool convert = job.cvtCode >= 0;
+    cv::Mat& resized = m_resizedImages[job.index];
+    cv::Mat& converted = m_convertedImages[job.index];
 
-    IplImage intermediate_image;
-    if (m_outNeedResize)
+    if (!job.hasAlpha)
     {
-        intermediate_image = m_tempImage;
+        if (!resize && !convert)
+        {
+            job.src.copyTo(dst);
+        }
+        else if (!convert)
+        {
+            // Resize straight into the output image.
+            ResizeInput(job, job.src, dst, dst.size());
+        }
+        else if (!resize)
+        {
+            // Convert straight into the output image.
+            cv::cvtColor(job.src, dst, job.cvtCode);
+        }
+        else if (dst.size().area() < job.src.size().area())
+        {
+            // Downscaling: resize in the input format, then convert into the output image.
+            ResizeInput(job, job.src, resized, dst.size());
+            cv::cvtColor(resized, dst, job.cvtCode);
+        }
+        else
+        {
+            // Upscaling: convert at the input size, then resize into the output image.
+            cv::cvtColor(job.src, converted, job.cvtCode);
+            ResizeInput(job, converted, dst, dst.size());
+        }
+        return;
     }
-    else
+
+    // If image has overlay channel, bring it to the output format and size (in buffers kept from one frame to
+    // the next), then blend it onto the output.
+    cv::Mat image = job.src;
+    const bool convertFirst = convert && (!resize || dst.size().area() >= job.src.size().area());
+    if (convertFirst)
     {
-        intermediate_image = imageOut;
+        cv::cvtColor(image, converted, job.cvtCode);
+        image = converted;
     }
+    if (resize)
+    {
+        ResizeInput(job, image, resized, dst.size());
+        image = resized;
+    }
+    if (convert && !convertFirst)
+    {
+        cv::cvtColor(image, converted, job.cvtCode);
+        image = converted;
+    }
+    AlphaBlend(image, dst);
+}
 
+void MAPSOpenCV_VideoMuxer::OutputResultImage(MAPSTimestamp t, const MAPS::ArrayView<MAPS::InputElt<IplImage>>& inElts)
+{
+    if (!m_outputInitialized)
+        return;
+    MAPS::OutputGuard<IplImage> outGuard{ this, Output(0) };
+    IplImage& imageOut = outGuard.Data();
+    outGuard.Timestamp() = t;
 
     {
+        //The image is composed in a canvas kept from one output to the next: only the inputs that changed since the
+        //previous output are redrawn, the canvas is then copied to the output buffer.
         const std::lock_guard<std::mutex> lock(m_zorderMutex);
+        if (!m_canvasValid)
+            ResetCanvas();
+        cv::Mat matOut = m_canvas;
+        const bool alphaCanvas = m_chanSeq == MAPS_CHANNELSEQ_BGRA || m_chanSeq == MAPS_CHANNELSEQ_RGBA;
+
+        m_composeJobs.clear();
         for (int i = 0; i < inElts.size(); i++)
         {
             int image_index = m_ioeltsOrder[i];
@@ -388,137 +813,118 @@ void MAPSOpenCV_VideoMuxer::OutputResultImage(MAPSTimestamp t, const MAPS::Array
             }
 
             const IplImage& imageIn = inElts[image_index].Data();
-            bool resize = false;
-
-            int pos_x = m_posX[image_index];
-            int pos_y = m_posY[image_index];
-            int width = m_width[image_index];
-            if (width == -1)
+            const MAPSUInt32 chanSeqIn = *reinterpret_cast<const MAPSUInt32*>(imageIn.channelSeq);
+            const bool alphaIn = chanSeqIn == MAPS_CHANNELSEQ_BGRA || chanSeqIn == MAPS_CHANNELSEQ_RGBA;
+
+            // The placement of an input only changes with its size, its format or its properties. The size is the one
+            // of the converted image, which only covers the IplImage roi when there is one.
+            const cv::Mat matIn = convTools::noCopyIplImage2Mat(&imageIn);
+            ResizePlan& plan = m_resizePlans[image_index];
+            const cv::Size sizeIn = matIn.size();
+            if (!plan.valid || plan.sizeIn != sizeIn || plan.chanSeqIn != chanSeqIn || plan.depthIn != imageIn.depth)
             {
-                width = imageIn.width;
+                //The format of an input may change while running: check it is still one we can convert.
+                CheckInputFormat(imageIn, image_index);
+                plan.valid = true;
+                plan.sizeIn = sizeIn;
+                plan.chanSeqIn = chanSeqIn;
+                plan.depthIn = imageIn.depth;
+                plan.cvtCode = GetColorConversionCode(chanSeqIn, m_chanSeq);
+                plan.placed = ComputeInputPlacement(i, image_index, sizeIn, plan.srcRect, plan.dstRect);
+                plan.decimation = 0;
+                for (int factor = 2; factor <= 4; factor *= 2)
+                {
+                    if (plan.srcRect.width == factor * plan.dstRect.width && plan.srcRect.height == factor * plan.dstRect.height)
+                        plan.decimation = factor;
+                }
             }
-            else if (width <= 0)
-            {
-                ReportWarning("Image N width should be positive or -1 for auto");
+            if (!plan.placed)
                 continue;
-            }
 
-            int height = m_height[image_index];
-            if (height == -1)
-            {
-                height = imageIn.height;
-            }
-            else if (height <= 0)
+            ComposeJob job;
+            job.dstRect = plan.dstRect;
+            job.index = image_index;
+            job.src = matIn(plan.srcRect);
+            job.cvtCode = plan.cvtCode;
+            job.hasAlpha = alphaIn && alphaCanvas; // the alpha channel is dropped on canvases without one
+            job.dirty = m_drawnFrames[image_index] != m_inputFrames[image_index];
+            m_composeJobs.push_back(job);
+        }
+
+        // Redrawing an input overwrites the inputs above it that it overlaps: they have to be redrawn too.
+        // On alpha canvases the dirty rectangles are cleared first, so the inputs below have to be redrawn as well.
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (size_t j = 0; j < m_composeJobs.size(); j++)
             {
-                ReportWarning("Image N height should be positive or -1 for auto");
-                continue;
+                if (m_composeJobs[j].dirty)
+                    continue;
+                for (size_t k = 0; k < m_composeJobs.size(); k++)
+                {
+                    if (m_composeJobs[k].dirty && (k < j || alphaCanvas) && (m_composeJobs[k].dstRect & m_composeJobs[j].dstRect).area() > 0)
+                    {
+                        m_composeJobs[j].dirty = true;
+                        changed = true;
+                        break;
+                    }
+                }
             }
+        }
 
-            if (imageIn.width != width || imageIn.height != height)
-                resize = true;
+        int max_level = 0;
+        for (size_t j = 0; j < m_composeJobs.size(); j++)
+        {
+            ComposeJob& job = m_composeJobs[j];
+            if (!job.dirty)
+                continue;
+            if (alphaCanvas)
+                matOut(job.dstRect).setTo(cv::Scalar::all(0));
 
-            if (pos_x > m_totalmWidth || pos_y > m_totalmHeight)
+            // An input has to be drawn after all the inputs with a lower z order that it overlaps.
+            job.level = 0;
+            for (size_t k = 0; k < j; k++)
             {
-                MAPSStreamedString s;
-                s << "Input image [" << i << "] out of bounds of output image. Please check left and top properties.";
-                ReportWarning(s);
-                continue;
+                if (m_composeJobs[k].dirty && (m_composeJobs[k].dstRect & job.dstRect).area() > 0)
+                    job.level = MAX(job.level, m_composeJobs[k].level + 1);
             }
-            if ((pos_x + width < 0) || (pos_y + height) < 0)
+            max_level = MAX(max_level, job.level);
+            m_drawnFrames[job.index] = m_inputFrames[job.index];
+        }
+
+        // Inputs of a same level do not overlap: draw them concurrently, one level after the other.
+        for (int level = 0; level <= max_level; level++)
+        {
+            m_levelJobs.clear();
+            for (size_t j = 0; j < m_composeJobs.size(); j++)
             {
-                MAPSStreamedString s;
-                s << "Input image [" << i << "] out of bounds of output image. Please check left, top, width and height properties.";
-                ReportWarning(s);
-                continue;
+                if (m_composeJobs[j].dirty && m_composeJobs[j].level == level)
+                    m_levelJobs.push_back(&m_composeJobs[j]);
             }
 
-            IplROI temp_roi;
-            intermediate_image.roi = &temp_roi;
-            IplROI& out_roi = *(intermediate_image.roi);
-
-            IplImage src_image = imageIn; //copy the header, not the data, this will allow to change the ROI.
-            IplROI src_roi;
-            src_roi.coi = 0;
-            src_image.roi = &src_roi; // Use a temporary ROI to avoid modifying the input image ROI
+            if (m_levelJobs.empty())
+                continue;
 
+            if (m_levelJobs.size() == 1)
+            {
+                cv::Mat dst = matOut(m_levelJobs[0]->dstRect);
+                ComposeInput(*m_levelJobs[0], dst);
+                continue;
+            }
 
-            if (!resize)
+            cv::parallel_for_(cv::Range(0, static_cast<int>(m_levelJobs.size())), [&](const cv::Range& range)
             {
-                src_roi.xOffset = pos_x < 0 ? -pos_x : 0; // In case the input image should be offset to the left, we cut out the left part of it
-                src_roi.yOffset = pos_y < 0 ? -pos_y : 0;
-                src_roi.width = MIN(pos_x + width, intermediate_image.width) - MAX(0, pos_x);
-                src_roi.height = MIN(pos_y + height, intermediate_image.height) - MAX(0, pos_y);
-
-                out_roi.coi = 0;
-                out_roi.xOffset = MAX(0, pos_x);
-                out_roi.yOffset = MAX(0, pos_y);
-                out_roi.width = src_roi.width;
-                out_roi.height = src_roi.height;
-
-                // If image has overlay channel, create a mask and apply it.
-                if (*(MAPSUInt32*)imageIn.channelSeq == MAPS_CHANNELSEQ_BGRA || *(MAPSUInt32*)imageIn.channelSeq == MAPS_CHANNELSEQ_RGBA)
+                for (int j = range.start; j < range.end; j++)
                 {
-                    cv::Mat mask = cv::Mat(cv::Size(imageIn.width, imageIn.height), CV_8U, 1);
-                    unsigned int* p, * line; // original image
-                    uchar* p_mask, * line_mask; // mask
-                    line = reinterpret_cast<unsigned int*>(imageIn.imageData);
-                    line_mask = reinterpret_cast<uchar*>(mask.data);
-                    for (; line < reinterpret_cast<unsigned int*>((imageIn.imageData + imageIn.imageSize)); line += imageIn.widthStep / 4, line_mask += mask.rows)
-                    {
-                        p = line;
-                        p_mask = line_mask;
-                        for (; p_mask < line_mask + mask.cols; ++p, ++p_mask)
-                        {
-                            int alpha = (*p >> 24) & 0xFF;
-                            if (alpha > 0)
-                                *p_mask = 1;
-                            else
-                                *p_mask = 0;
-                        }
-                    }
-                    cv::copyTo(convTools::noCopyIplImage2Mat(&src_image), convTools::noCopyIplImage2Mat(&intermediate_image), mask);
-                }
-                else
-                {
-                    cv::Mat matIn = convTools::noCopyIplImage2Mat(&src_image);
-                    cv::Mat matOut =  convTools::noCopyIplImage2Mat(&intermediate_image);
-                    cv::copyTo(matIn, matOut, cv::noArray());
+                    const ComposeJob& job = *m_levelJobs[j];
+                    cv::Mat dst = matOut(job.dstRect);
+                    ComposeInput(job, dst);
                 }
-
-            }
-            else
-            {
-                IplROI resized_img_roi;
-
-                resized_img_roi.coi = 0;
-                resized_img_roi.xOffset = -(MIN(0, pos_x));
-                resized_img_roi.yOffset = -(MIN(0, pos_y));
-                resized_img_roi.width = MIN(pos_x + width, intermediate_image.width) - MAX(0, pos_x);
-                resized_img_roi.height = MIN(pos_y + height, intermediate_image.height) - MAX(0, pos_y);
-                out_roi.coi = 0;
-                out_roi.xOffset = MAX(0, pos_x);
-                out_roi.yOffset = MAX(0, pos_y);
-                out_roi.width = resized_img_roi.width;
-                out_roi.height = resized_img_roi.height;
-
-                src_image.roi->xOffset = resized_img_roi.xOffset * src_image.width / width;
-                src_image.roi->yOffset = resized_img_roi.yOffset * src_image.height / height;
-                src_image.roi->width = resized_img_roi.width * src_image.width / width;
-                src_image.roi->height = resized_img_roi.height * src_image.height / height;
-
-                cv::Mat src_mat = convTools::noCopyIplImage2Mat(&src_image);
-                cv::Mat intermediate_mat = convTools::noCopyIplImage2Mat(&intermediate_image);
-                cv::resize(src_mat, intermediate_mat, intermediate_mat.size());
-
-            }
+            });
         }
-    }
-    if (m_outNeedResize)
-    {
-        cv::Mat out_mat = convTools::noCopyIplImage2Mat(&imageOut);
-        intermediate_image.roi = nullptr;
-        cv::Mat intermediate_mat = convTools::noCopyIplImage2Mat(&intermediate_image);
-        cv::resize(intermediate_mat, out_mat, out_mat.size());
+
+        m_canvas.copyTo(convTools::noCopyIplImage2Mat(&imageOut));
     }
 }
 
@@ -556,44 +962,79 @@ void MAPSOpenCV_VideoMuxer::Set(MAPSProperty& p, MAPSInt64 value)
             if (&p == &Property(i* Property_NumberOfProperties + m_firstPositionPropRuntime + 1))
             {
                 m_posX[i] = static_cast<int>(value);
-                m_bgInitialized.clear();
+                m_resizePlans[i].valid = false;
+                m_canvasValid = false;
                 break;
             }
             else if (&p == &Property(i* Property_NumberOfProperties + m_firstPositionPropRuntime + 2))
             {
                 m_posY[i] = static_cast<int>(value);
-                m_bgInitialized.clear();
+                m_resizePlans[i].valid = false;
+                m_canvasValid = false;
                 break;
             }
             else if (&p == &Property(i* Property_NumberOfProperties + m_firstPositionPropRuntime + 3))
             {
                 m_width[i] = static_cast<int>(value);
-                m_bgInitialized.clear();
+                m_resizePlans[i].valid = false;
+                m_canvasValid = false;
                 break;
             }
             else if (&p == &Property(i* Property_NumberOfProperties + m_firstPositionPropRuntime + 4))
             {
                 m_height[i] = static_cast<int>(value);
-                m_bgInitialized.clear();
+                m_resizePlans[i].valid = false;
+                m_canvasValid = false;
                 break;
             }
             else if (&p == &Property(i* Property_NumberOfProperties + m_firstPositionPropRuntime + 5))
             {
                 m_zOrder[i] = static_cast<int>(value);
                 SortIOEltsByZOrder();
+                m_canvasValid = false;
                 break;
             }
         }
     }
 }
 
-void MAPSOpenCV_VideoMuxer::Initialization(const MAPSTimestamp, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+void MAPSOpenCV_VideoMuxer::SetOutputFormat(const IplImage& imageIn)
 {
-    const IplImage& imageIn = inElts[0].Data();
-    m_chanSeq = *reinterpret_cast<const MAPSUInt32*>(imageIn.channelSeq);
+    static const MAPSUInt32 s_outColorFormats[] = { 0, MAPS_CHANNELSEQ_GRAY, MAPS_CHANNELSEQ_RGB, MAPS_CHANNELSEQ_BGR, MAPS_CHANNELSEQ_RGBA, MAPS_CHANNELSEQ_BGRA };
+
+    if (m_outColorFormat > 0)
+        m_chanSeq = s_outColorFormats[m_outColorFormat];
+    else
+        m_chanSeq = *reinterpret_cast<const MAPSUInt32*>(imageIn.channelSeq);
     m_dataOrder = imageIn.dataOrder;
     m_depth = imageIn.depth;
     m_align = imageIn.align;
+}
+
+void MAPSOpenCV_VideoMuxer::CheckInputFormat(const IplImage& imageIn, int inputIndex)
+{
+    const MAPSUInt32 chanSeqIn = *reinterpret_cast<const MAPSUInt32*>(imageIn.channelSeq);
+    if (chanSeqIn == m_chanSeq && static_cast<unsigned int>(imageIn.depth) == m_depth)
+        return;
+
+    //Images in another format are converted while being drawn.
+    if (!IsConvertibleFormat(chanSeqIn) || !IsConvertibleFormat(m_chanSeq))
+    {
+        MAPSStreamedString sx;
+        sx << "Image format error on input " << Input(inputIndex).ShortName() << ". Input images with different color formats must be GRAY, RGB, BGR, RGBA or BGRA.";
+        Error(sx);
+    }
+    if (static_cast<unsigned int>(imageIn.depth) != m_depth || (m_depth != IPL_DEPTH_8U && m_depth != IPL_DEPTH_16U))
+    {
+        MAPSStreamedString sx;
+        sx << "Image format error on input " << Input(inputIndex).ShortName() << ". All input images must have the same depth (8 or 16 bits).";
+        Error(sx);
+    }
+}
+
+void MAPSOpenCV_VideoMuxer::Initialization(const MAPSTimestamp, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    SetOutputFormat(inElts[0].Data());
 
     for (int i = 0; i < m_nbInputs; i++)
     {
@@ -605,40 +1046,73 @@ void MAPSOpenCV_VideoMuxer::Initialization(const MAPSTimestamp, const MAPS::Arra
         {
             m_height[i] = inElts[i].Data().height;
         }
-        if (*reinterpret_cast<const MAPSUInt32*>(inElts[i].Data().channelSeq) != m_chanSeq)
-        {
-            MAPSStreamedString sx;
-            sx << "Image format error on input " << Input(i).ShortName() << ". All input images must have the same color format.";
-            Error(sx);
-        }
+        CheckInputFormat(inElts[i].Data(), i);
     }
     ComputeSizesAndAllocOutBuffer();
 }
 
 void MAPSOpenCV_VideoMuxer::Initialization_Reactive(const MAPSTimestamp, const size_t inputThatAnswered, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
 {
-    const IplImage& imageIn = inElts[inputThatAnswered].Data();
-    m_chanSeq = *reinterpret_cast<const MAPSUInt32*>(imageIn.channelSeq);
-    m_dataOrder = imageIn.dataOrder;
-    m_depth = imageIn.depth;
-    m_align = imageIn.align;
+    SetOutputFormat(inElts[inputThatAnswered].Data());
 }
 
 void MAPSOpenCV_VideoMuxer::Initialization_Trigerred(const MAPSTimestamp, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
 {
-    const IplImage& imageIn = inElts[0].Data();
-    m_chanSeq = *reinterpret_cast<const MAPSUInt32*>(imageIn.channelSeq);
-    m_dataOrder = imageIn.dataOrder;
-    m_depth = imageIn.depth;
-    m_align = imageIn.align;
+    SetOutputFormat(inElts[0].Data());
 }
 
 void MAPSOpenCV_VideoMuxer::ProcessData(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
 {
+    for (int i = 0; i < m_nbInputs; i++)
+        m_inputFrames[i]++;
+    OutputResultImage(ts, inElts);
+}
+
+void MAPSOpenCV_VideoMuxer::ProcessData_Periodic(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    //The latest image of each input is sampled at each period: only the inputs that received a new image since the
+    //previous period have to be redrawn.
+    for (int i = 0; i < m_nbInputs; i++)
+    {
+        if (!inElts[i].IsValid())
+            continue;
+        const void* data = inElts[i].Data().imageData;
+        if (data != m_lastSampledData[i] || inElts[i].Timestamp() != m_lastSampledTs[i])
+        {
+            m_lastSampledData[i] = data;
+            m_lastSampledTs[i] = inElts[i].Timestamp();
+            m_inputFrames[i]++;
+        }
+    }
     OutputResultImage(ts, inElts);
 }
 
 void MAPSOpenCV_VideoMuxer::ProcessData_Reactive(const MAPSTimestamp ts, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    if (!InitializeSizes(inElts))
+        return;
+
+    //All the inputs may have changed since the last trigger.
+    for (int i = 0; i < m_nbInputs; i++)
+        m_inputFrames[i]++;
+
+    //Do the job.
+    OutputResultImage(ts, inElts);
+}
+
+void MAPSOpenCV_VideoMuxer::ProcessData_Async(const MAPSTimestamp ts, const size_t inputThatAnswered, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    if (!InitializeSizes(inElts))
+        return;
+
+    //Only the input that answered changed: the other ones are carried over from what the output buffer already holds.
+    m_inputFrames[inputThatAnswered]++;
+
+    //Do the job.
+    OutputResultImage(ts, inElts);
+}
+
+bool MAPSOpenCV_VideoMuxer::InitializeSizes(const MAPS::ArrayView<MAPS::InputElt<IplImage>>& inElts)
 {
     if (!m_allSizesInitialized)
     {
@@ -650,12 +1124,7 @@ void MAPSOpenCV_VideoMuxer::ProcessData_Reactive(const MAPSTimestamp ts, const M
             const IplImage& imageIn = inElts[i].Data();
 
             //Check image format.
-            if (*reinterpret_cast<const MAPSUInt32*>(imageIn.channelSeq) != m_chanSeq)
-            {
-                MAPSStreamedString sx;
-                sx << "Image format error on input " << inElts[i].Input()->ShortName() << ". All input images must have the same color format.";
-                Error(sx);
-            }
+            CheckInputFormat(imageIn, static_cast<int>(i));
 
            
             if (!m_sizeInitialized[i])
@@ -682,7 +1151,7 @@ void MAPSOpenCV_VideoMuxer::ProcessData_Reactive(const MAPSTimestamp ts, const M
             }
         }
 
-        return;
+        return false;
     }
 
     if (m_firstTimeAllInit)
@@ -690,8 +1159,5 @@ void MAPSOpenCV_VideoMuxer::ProcessData_Reactive(const MAPSTimestamp ts, const M
         m_firstTimeAllInit = false;
         ComputeSizesAndAllocOutBuffer();
     }
-
-    //Do the job.
-    OutputResultImage(ts, inElts);
+    return true;
 }
-
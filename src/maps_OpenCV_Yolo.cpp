@@ -33,21 +33,43 @@ MAPS_BEGIN_INPUTS_DEFINITION(MAPSOpenCV_Yolo)
     MAPS_INPUT("imageIn", MAPS::FilterIplImage, MAPS::FifoReader)
 MAPS_END_INPUTS_DEFINITION
 
-#define MAX_DOBJS_OUT 64
+#define DETECTION_NB_FLOATS 6 // packed detections: class, score, x1, y1, x2, y2
+#define STATS_MAX_SIZE 8192
 // Use the macros to declare the outputs
 MAPS_BEGIN_OUTPUTS_DEFINITION(MAPSOpenCV_Yolo)
-	MAPS_OUTPUT("bounding_boxes",MAPS::DrawingObject, nullptr, nullptr, MAX_DOBJS_OUT)
-	MAPS_OUTPUT("labels", MAPS::DrawingObject, nullptr, nullptr, MAX_DOBJS_OUT)
+	MAPS_OUTPUT("bounding_boxes",MAPS::DrawingObject, nullptr, nullptr, 0)
+	MAPS_OUTPUT("labels", MAPS::DrawingObject, nullptr, nullptr, 0)
+	MAPS_OUTPUT("status", MAPS::TextAscii, nullptr, nullptr, 256)
+	MAPS_OUTPUT("detections", MAPS::Float32, nullptr, nullptr, 0)
+	MAPS_OUTPUT("stats", MAPS::TextAscii, nullptr, nullptr, STATS_MAX_SIZE)
 	MAPS_END_OUTPUTS_DEFINITION
 
 // Use the macros to declare the properties
 MAPS_BEGIN_PROPERTIES_DEFINITION(MAPSOpenCV_Yolo)
-    MAPS_PROPERTY_SUBTYPE("cfg_path", "", false, false, MAPS::PropertySubTypeFile | MAPS::PropertySubTypeMustExist) // Path to the .cfg file
+    MAPS_PROPERTY_SUBTYPE("cfg_path", "", false, false, MAPS::PropertySubTypeFile | MAPS::PropertySubTypeMustExist) // Path to the .cfg file (darknet models only)
     MAPS_PROPERTY_SUBTYPE("names_path", "", false, false, MAPS::PropertySubTypeFile | MAPS::PropertySubTypeMustExist) // Path to the .names file
-    MAPS_PROPERTY_SUBTYPE("weights_path", "", false, false, MAPS::PropertySubTypeFile | MAPS::PropertySubTypeMustExist) // Path to the .weights file
+    MAPS_PROPERTY_SUBTYPE("weights_path", "", false, false, MAPS::PropertySubTypeFile | MAPS::PropertySubTypeMustExist) // Path to the .weights or .onnx file
     MAPS_PROPERTY("confidence_threshold", 0.5, false, true) // A threshold to filter detection confidence
     MAPS_PROPERTY("nms_threshold", 0.4, false, true) // A threshold to filter overlapping detection boxes (non maximum suppression)
     MAPS_PROPERTY("text_thickness", 1.0, false, true) 
+    MAPS_PROPERTY("input_width", 416, false, false) // Network input width (-1: image width)
+    MAPS_PROPERTY("input_height", 416, false, false) // Network input height (-1: image height)
+    MAPS_PROPERTY_ENUM("resize_mode", "Stretch|Letterbox (keep aspect ratio)", 0, false, false)
+    MAPS_PROPERTY("nb_inputs", 1, false, false) // Number of cameras processed in the same network batch
+    MAPS_PROPERTY("synchro_tolerance", 20000, false, false) // Synchronization tolerance between the inputs (microseconds)
+    MAPS_PROPERTY("tile_size", 0, false, false) // Size of the square tiles the images are split into, in image pixels (0: no tiling)
+    MAPS_PROPERTY("tile_overlap", 64, false, false) // Minimum overlap between neighbouring tiles, in image pixels
+    MAPS_PROPERTY("detection_interval", 1, false, false) // The network runs every N images, the boxes are tracked in between (1: no tracking)
+    MAPS_PROPERTY("motion_gating", false, false, false) // Skip the network when nothing moves in the images
+    MAPS_PROPERTY("motion_threshold", 20, false, true) // Gray level difference for a pixel of the downsampled image to be considered as moving
+    MAPS_PROPERTY("motion_min_pixels", 4, false, true) // Minimum number of moving pixels (in the downsampled image) to run the network
+    MAPS_PROPERTY("motion_crop", false, false, false) // Run the network on the region of the motion only (without tiling)
+    MAPS_PROPERTY("max_detections", 64, false, false) // Maximum number of detections output per image
+    MAPS_PROPERTY("output_labels", true, false, false) // Create the labels outputs (text drawing objects)
+    MAPS_PROPERTY("output_stats", false, false, false) // Create the stats output (per-layer inference timings)
+    MAPS_PROPERTY_ENUM("backend", "OpenCV|OpenVINO", 0, false, false) // DNN backend
+    MAPS_PROPERTY_ENUM("target", "CPU|CPU FP16", 0, false, false) // DNN target
+    MAPS_PROPERTY("nb_threads", 0, false, false) // Number of threads used by OpenCV (0: OpenCV default)
 MAPS_END_PROPERTIES_DEFINITION
 
 // Use the macros to declare the actions
@@ -56,21 +78,456 @@ MAPS_BEGIN_ACTIONS_DEFINITION(MAPSOpenCV_Yolo)
 MAPS_END_ACTIONS_DEFINITION
 
 // Use the macros to declare this component (OpenCV_Resize) behaviour
-MAPS_COMPONENT_DEFINITION(MAPSOpenCV_Yolo, "OpenCV_Yolo", "1.1.0", 128,
+MAPS_COMPONENT_DEFINITION(MAPSOpenCV_Yolo, "OpenCV_Yolo", "1.12.6", 128,
     MAPS::Threaded, MAPS::Threaded,
-    -1, // Nb of inputs
-    -1, // Nb of outputs
+     0, // Nb of inputs
+     0, // Nb of outputs
     -1, // Nb of properties
     -1) // Nb of actions
 
+#define RESIZE_MODE_STRETCH   0
+#define RESIZE_MODE_LETTERBOX 1
+
+#define LETTERBOX_PAD_VALUE 114
+
+// Detections closer than this to a tile border shared with another tile are cut by the border:
+// they are discarded, the neighbouring tile (or the full image) seeing the whole object.
+#define TILE_BORDER_MARGIN 4
+
+#define BACKEND_OPENCV   0
+#define BACKEND_OPENVINO 1
+
+#define TARGET_CPU      0
+#define TARGET_CPU_FP16 1
+
+#define GATING_WIDTH          160  // the motion is detected on images downscaled to this width
+#define GATING_CROP_MARGIN    0.1  // the motion region is enlarged by this ratio of the image size on each side
+
+#define TRACKING_MAX_WIDTH    640  // the optical flow runs on images downscaled to this width at most
+#define TRACKING_GRID         4    // grid of TRACKING_GRID x TRACKING_GRID points followed in each box
+#define TRACKING_MIN_POINTS   4    // minimum number of points followed to measure the motion of a box
+#define TRACKING_MIN_IOU      0.3  // minimum IoU to associate a detection to a track
+#define TRACKING_MAX_MISSES   2    // a track is dropped after this number of detection rounds without a matching detection
+
+YoloTracker::YoloTracker()
+{
+    Reset();
+}
+
+void YoloTracker::Reset()
+{
+    m_tracks.clear();
+    m_nextId = 0;
+}
+
+static double BoxIoU(const cv::Rect2d& a, const cv::Rect2d& b)
+{
+    const double inter = (a & b).area();
+    const double uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter / uni : 0.0;
+}
+
+// Moves boxes from prevGray to gray (tracking images, scale x the image coordinates) according to the median
+// displacement and scale change of a grid of points inside each box. found[i] is 0 when the motion of box i is unknown.
+void YoloTracker::PropagateBoxes(const cv::Mat& prevGray, const cv::Mat& gray, double scale, std::vector<cv::Rect2d>& boxes, std::vector<uchar>& found)
+{
+    found.assign(boxes.size(), 0);
+    if (boxes.empty())
+        return;
+
+    //All the points of all the boxes are followed by a single optical flow computation
+    m_points.clear();
+    for (const cv::Rect2d& box : boxes)
+    {
+        for (int gy = 0; gy < TRACKING_GRID; gy++)
+        {
+            for (int gx = 0; gx < TRACKING_GRID; gx++)
+            {
+                const double x = box.x + box.width * (gx + 1) / (TRACKING_GRID + 1);
+                const double y = box.y + box.height * (gy + 1) / (TRACKING_GRID + 1);
+                m_points.push_back(cv::Point2f(static_cast<float>(x * scale), static_cast<float>(y * scale)));
+            }
+        }
+    }
+    cv::calcOpticalFlowPyrLK(prevGray, gray, m_points, m_nextPoints, m_status, m_err, cv::Size(15, 15), 2);
+
+    const int nbPoints = TRACKING_GRID * TRACKING_GRID;
+    std::vector<float> dx, dy, ratios;
+    for (size_t b = 0; b < boxes.size(); b++)
+    {
+        const cv::Point2f* p0 = &m_points[b * nbPoints];
+        const cv::Point2f* p1 = &m_nextPoints[b * nbPoints];
+        const uchar* status = &m_status[b * nbPoints];
+
+        dx.clear();
+        dy.clear();
+        cv::Point2f c0(0, 0), c1(0, 0);
+        for (int k = 0; k < nbPoints; k++)
+        {
+            if (!status[k])
+                continue;
+            dx.push_back(p1[k].x - p0[k].x);
+            dy.push_back(p1[k].y - p0[k].y);
+            c0 += p0[k];
+            c1 += p1[k];
+        }
+        const int n = static_cast<int>(dx.size());
+        if (n < TRACKING_MIN_POINTS)
+            continue;
+        c0 *= 1.f / n;
+        c1 *= 1.f / n;
+
+        //Scale change: median ratio of the distances to the centroid
+        ratios.clear();
+        for (int k = 0; k < nbPoints; k++)
+        {
+            const double d0 = cv::norm(p0[k] - c0);
+            if (status[k] && d0 > 1.0)
+                ratios.push_back(static_cast<float>(cv::norm(p1[k] - c1) / d0));
+        }
+
+        std::nth_element(dx.begin(), dx.begin() + n / 2, dx.end());
+        std::nth_element(dy.begin(), dy.begin() + n / 2, dy.end());
+        double ratio = 1.0;
+        if (!ratios.empty())
+        {
+            std::nth_element(ratios.begin(), ratios.begin() + ratios.size() / 2, ratios.end());
+            ratio = ratios[ratios.size() / 2];
+        }
+
+        cv::Rect2d& box = boxes[b];
+        const double cx = box.x + box.width / 2 + dx[n / 2] / scale;
+        const double cy = box.y + box.height / 2 + dy[n / 2] / scale;
+        box.width *= ratio;
+        box.height *= ratio;
+        box.x = cx - box.width / 2;
+        box.y = cy - box.height / 2;
+        found[b] = 1;
+    }
+}
+
+void YoloTracker::CorrectTrack(YoloTrack& track, const cv::Rect2d& box, float noise)
+{
+    cv::setIdentity(track.kalman.measurementNoiseCov, cv::Scalar::all(noise));
+    const cv::Mat measurement = (cv::Mat_<float>(4, 1) << static_cast<float>(box.x + box.width / 2), static_cast<float>(box.y + box.height / 2),
+        static_cast<float>(box.width), static_cast<float>(box.height));
+    const cv::Mat& state = track.kalman.correct(measurement);
+    track.box.width = state.at<float>(2);
+    track.box.height = state.at<float>(3);
+    track.box.x = state.at<float>(0) - track.box.width / 2;
+    track.box.y = state.at<float>(1) - track.box.height / 2;
+}
+
+void YoloTracker::Track(const cv::Mat& prevGray, const cv::Mat& gray, double scale)
+{
+    m_boxes.clear();
+    for (const YoloTrack& track : m_tracks)
+        m_boxes.push_back(track.box);
+    PropagateBoxes(prevGray, gray, scale, m_boxes, m_found);
+
+    for (size_t t = 0; t < m_tracks.size(); t++)
+    {
+        YoloTrack& track = m_tracks[t];
+        const cv::Mat& state = track.kalman.predict();
+        if (m_found[t])
+        {
+            CorrectTrack(track, m_boxes[t], 4.f);
+        }
+        else
+        {
+            //No reliable optical flow: constant velocity prediction
+            track.box.width = state.at<float>(2);
+            track.box.height = state.at<float>(3);
+            track.box.x = state.at<float>(0) - track.box.width / 2;
+            track.box.y = state.at<float>(1) - track.box.height / 2;
+        }
+    }
+}
+
+void YoloTracker::Update(const std::vector<YoloDetection>& detections, const cv::Mat& keyGray, const cv::Mat& gray, double scale)
+{
+    //Bring the detections from the image they were computed on to the current one
+    m_boxes.clear();
+    for (const YoloDetection& d : detections)
+        m_boxes.push_back(cv::Rect2d(d.box));
+    if (keyGray.data != gray.data)
+        PropagateBoxes(keyGray, gray, scale, m_boxes, m_found);
+
+    //Greedy association: best IoU first, same class only
+    std::vector<std::pair<double, std::pair<int, int>>> pairs;
+    for (size_t t = 0; t < m_tracks.size(); t++)
+    {
+        for (size_t d = 0; d < detections.size(); d++)
+        {
+            if (m_tracks[t].classId != detections[d].classId)
+                continue;
+            const double iou = BoxIoU(m_tracks[t].box, m_boxes[d]);
+            if (iou >= TRACKING_MIN_IOU)
+                pairs.push_back(std::make_pair(iou, std::make_pair(static_cast<int>(t), static_cast<int>(d))));
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const std::pair<double, std::pair<int, int>>& a, const std::pair<double, std::pair<int, int>>& b) { return a.first > b.first; });
+
+    std::vector<uchar> trackMatched(m_tracks.size(), 0);
+    std::vector<uchar> detectionMatched(detections.size(), 0);
+    for (const auto& p : pairs)
+    {
+        const int t = p.second.first;
+        const int d = p.second.second;
+        if (trackMatched[t] || detectionMatched[d])
+            continue;
+        trackMatched[t] = detectionMatched[d] = 1;
+        CorrectTrack(m_tracks[t], m_boxes[d], 1.f);
+        m_tracks[t].score = detections[d].score;
+        m_tracks[t].misses = 0;
+    }
+
+    //Tracks not confirmed by the network for too long are dropped
+    size_t kept = 0;
+    for (size_t t = 0; t < m_tracks.size(); t++)
+    {
+        if (!trackMatched[t] && ++m_tracks[t].misses > TRACKING_MAX_MISSES)
+            continue;
+        if (kept != t)
+            m_tracks[kept] = m_tracks[t];
+        kept++;
+    }
+    m_tracks.resize(kept);
+
+    //New objects
+    for (size_t d = 0; d < detections.size(); d++)
+    {
+        if (detectionMatched[d])
+            continue;
+        YoloTrack track;
+        track.id = m_nextId++;
+        track.classId = detections[d].classId;
+        track.score = detections[d].score;
+        track.box = m_boxes[d];
+        track.misses = 0;
+
+        //Constant velocity model: [cx, cy, w, h, vx, vy, vw, vh]
+        track.kalman.init(8, 4, 0, CV_32F);
+        cv::setIdentity(track.kalman.transitionMatrix);
+        for (int k = 0; k < 4; k++)
+            track.kalman.transitionMatrix.at<float>(k, k + 4) = 1.f;
+        cv::setIdentity(track.kalman.measurementMatrix);
+        cv::setIdentity(track.kalman.processNoiseCov, cv::Scalar::all(1e-1));
+        cv::setIdentity(track.kalman.errorCovPost, cv::Scalar::all(10.));
+        track.kalman.statePost.at<float>(0) = static_cast<float>(track.box.x + track.box.width / 2);
+        track.kalman.statePost.at<float>(1) = static_cast<float>(track.box.y + track.box.height / 2);
+        track.kalman.statePost.at<float>(2) = static_cast<float>(track.box.width);
+        track.kalman.statePost.at<float>(3) = static_cast<float>(track.box.height);
+        m_tracks.push_back(track);
+    }
+}
+
+void YoloTracker::GetDetections(std::vector<YoloDetection>& detections) const
+{
+    detections.clear();
+    for (const YoloTrack& track : m_tracks)
+    {
+        YoloDetection d;
+        d.classId = track.classId;
+        d.score = track.score;
+        d.box = cv::Rect(cvRound(track.box.x), cvRound(track.box.y), cvRound(track.box.width), cvRound(track.box.height));
+        d.trackId = track.id;
+        detections.push_back(d);
+    }
+}
+
+// Process-wide registry of the loaded networks, shared by the component instances using the same model files
+// and input size on the same backend and target. A model is released when its last instance dies.
+struct YoloModelEntry
+{
+    std::weak_ptr<YoloSharedModel> model;
+    std::shared_future<void> loaded; // ready once the model is loaded, holds the loading exception if it failed
+};
+static std::mutex s_modelRegistryMutex;
+static std::map<std::string, YoloModelEntry> s_modelRegistry;
+
+static std::shared_ptr<YoloSharedModel> AcquireSharedModel(const std::string& configPath, const std::string& weightPath, bool isOnnx, cv::Size inputSize, int backend, int target)
+{
+    const std::string key = configPath + "|" + weightPath + "|" + std::to_string(inputSize.width) + "x" + std::to_string(inputSize.height)
+        + "|" + std::to_string(backend) + "|" + std::to_string(target);
+
+    //The registry lock is only held to find or create the entry: the model is loaded outside of it, so that the
+    //instances using other models do not wait. The instances starting together on the same model wait for the
+    //first one to load it.
+    std::shared_ptr<YoloSharedModel> model;
+    std::shared_future<void> loadedByOther;
+    std::promise<void> loadedPromise;
+    {
+        std::lock_guard<std::mutex> lock(s_modelRegistryMutex);
+        YoloModelEntry& entry = s_modelRegistry[key];
+        model = entry.model.lock();
+        if (model)
+        {
+            loadedByOther = entry.loaded;
+        }
+        else
+        {
+            model = std::make_shared<YoloSharedModel>();
+            entry.model = model;
+            entry.loaded = loadedPromise.get_future().share();
+
+            //Forget the entries of the models released in the meantime
+            for (auto it = s_modelRegistry.begin(); it != s_modelRegistry.end();)
+            {
+                if (it->second.model.expired())
+                    it = s_modelRegistry.erase(it);
+                else
+                    ++it;
+            }
+        }
+    }
+
+    if (loadedByOther.valid())
+    {
+        loadedByOther.get(); // rethrows the loading error
+        return model;
+    }
+
+    try
+    {
+        if (isOnnx)
+            model->net = cv::dnn::readNetFromONNX(weightPath);
+        else
+            model->net = cv::dnn::readNetFromDarknet(configPath, weightPath);
+        model->net.setPreferableBackend(backend);
+        model->net.setPreferableTarget(target);
+        model->outNames = model->net.getUnconnectedOutLayersNames();
+    }
+    catch (...)
+    {
+        //The instances waiting for this model get the same error, the next one will try to load it again
+        loadedPromise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(s_modelRegistryMutex);
+        auto it = s_modelRegistry.find(key);
+        if (it != s_modelRegistry.end() && it->second.model.lock() == model)
+            s_modelRegistry.erase(it);
+        throw;
+    }
+    loadedPromise.set_value();
+    return model;
+}
+
+// Start positions of the tiles covering [0, length[ with at least the given overlap, the last tile ending on the border
+static void ComputeTileStarts(int length, int tileSize, int overlap, std::vector<int>& starts)
+{
+    starts.clear();
+    if (length <= tileSize)
+    {
+        starts.push_back(0);
+        return;
+    }
+    const int stride = tileSize - overlap;
+    const int nbTiles = 1 + (length - tileSize + stride - 1) / stride;
+    const double step = static_cast<double>(length - tileSize) / (nbTiles - 1);
+    for (int i = 0; i < nbTiles; i++)
+        starts.push_back(cvRound(i * step));
+}
+
+// Non maximum suppression done independently for each class, with a single call for all the classes.
+static void NMSPerClass(const std::vector<YoloDetection>& candidates, float confThreshold, float nmsThreshold, std::vector<YoloDetection>& detections)
+{
+    detections.clear();
+    if (candidates.empty())
+        return;
+
+    std::vector<cv::Rect> boxes;
+    std::vector<float> scores;
+    boxes.reserve(candidates.size());
+    scores.reserve(candidates.size());
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+    std::vector<int> classIds;
+    classIds.reserve(candidates.size());
+    for (const YoloDetection& d : candidates)
+    {
+        boxes.push_back(d.box);
+        scores.push_back(d.score);
+        classIds.push_back(d.classId);
+    }
+
+    std::vector<int> indices;
+    cv::dnn::NMSBoxesBatched(boxes, scores, classIds, confThreshold, nmsThreshold, indices); // indices are sorted by decreasing score
+#else
+    //Boxes are offset by class so that boxes of different classes never overlap. Boxes may stick out of the image
+    //(negative coordinates): the offset covers the whole extent of the boxes.
+    int minCoord = INT_MAX;
+    int maxCoord = INT_MIN;
+    for (const YoloDetection& d : candidates)
+    {
+        minCoord = MIN(minCoord, MIN(d.box.x, d.box.y));
+        maxCoord = MAX(maxCoord, MAX(d.box.x + d.box.width, d.box.y + d.box.height));
+    }
+    const int extent = maxCoord - minCoord + 1;
+
+    for (const YoloDetection& d : candidates)
+    {
+        const int offset = d.classId * extent - minCoord;
+        boxes.push_back(cv::Rect(d.box.x + offset, d.box.y + offset, d.box.width, d.box.height));
+        scores.push_back(d.score);
+    }
+
+    std::vector<int> indices;
+    cv::dnn::NMSBoxes(boxes, scores, confThreshold, nmsThreshold, indices); // indices are sorted by decreasing score
+#endif
+    for (int idx : indices)
+        detections.push_back(candidates[idx]);
+}
+
+void MAPSOpenCV_Yolo::Dynamic()
+{
+    m_nbInputs = static_cast<int>(GetIntegerProperty("nb_inputs"));
+    if (m_nbInputs < 1)
+        Error("The number of inputs must be at least 1.");
+
+    const bool outputLabels = GetBoolProperty("output_labels");
+
+    //Create one input and one bounding_boxes/labels/detections output set per camera.
+    //With a single input, the original names are kept.
+    m_inputs.clear();
+    m_outputs.clear();
+    for (int i = 0; i < m_nbInputs; i++)
+    {
+        YoloInputOutputs outputs;
+        if (m_nbInputs == 1)
+        {
+            m_inputs.push_back(&NewInput(0));
+            outputs.boundingBoxes = &NewOutput(0);
+            outputs.labels = outputLabels ? &NewOutput(1) : nullptr;
+            outputs.detections = &NewOutput(3);
+        }
+        else
+        {
+            MAPSStreamedString iname, bbname, labelsname, detectionsname;
+            iname << "imageIn_" << (i + 1);
+            bbname << "bounding_boxes_" << (i + 1);
+            labelsname << "labels_" << (i + 1);
+            detectionsname << "detections_" << (i + 1);
+            m_inputs.push_back(&NewInput(0, iname));
+            outputs.boundingBoxes = &NewOutput(0, bbname);
+            outputs.labels = outputLabels ? &NewOutput(1, labelsname) : nullptr;
+            outputs.detections = &NewOutput(3, detectionsname);
+        }
+        m_outputs.push_back(outputs);
+    }
+    m_statusOutput = &NewOutput(2);
+    m_statsOutput = GetBoolProperty("output_stats") ? &NewOutput(4) : nullptr;
+}
+
 void MAPSOpenCV_Yolo::Birth()
 {
     std::string namesPath(static_cast<const char*>(GetStringProperty("names_path")));
     std::string configPath(static_cast<const char*>(GetStringProperty("cfg_path")));
     std::string weightPath(static_cast<const char*>(GetStringProperty("weights_path")));
 
-    if (namesPath.empty() || configPath.empty() || weightPath.empty())
-        Error("Please specify the needed files (.weights, .cfg and .names");
+    //ONNX exports (YOLOv5, YOLOv8...) contain both the architecture and the weights, no .cfg file is needed
+    m_isOnnx = weightPath.size() >= 5 && cv::toLowerCase(weightPath.substr(weightPath.size() - 5)) == ".onnx";
+
+    if (namesPath.empty() || weightPath.empty() || (configPath.empty() && !m_isOnnx))
+        Error("Please specify the needed files (.weights, .cfg and .names, or .onnx and .names)");
 
     //Get the names of the objects it was trained for
     m_classes.clear();
@@ -80,15 +537,100 @@ void MAPSOpenCV_Yolo::Birth()
         m_classes.push_back(line);
     }
 
-    //Create the model thanks to the config and the weight files
-    m_model = cv::dnn::DetectionModel(configPath, weightPath);
+    m_inputSize = cv::Size(static_cast<int>(GetIntegerProperty("input_width")), static_cast<int>(GetIntegerProperty("input_height")));
+    m_resizeMode = static_cast<int>(GetIntegerProperty("resize_mode"));
+    if ((m_inputSize.width > 0 && m_inputSize.width % 32 != 0) || (m_inputSize.height > 0 && m_inputSize.height % 32 != 0))
+        Error("The network input width and height must be multiples of 32 (e.g. 416 or 608).");
 
-    m_inputReader = MAPS::MakeInputReader::Reactive(
-        this,
-        Input(0),
-        &MAPSOpenCV_Yolo::AllocateOutputBufferSize,  // Called when data is received for the first time only
-        &MAPSOpenCV_Yolo::ProcessData      // Called when data is received for the first time AND all subsequent times
-    );
+    m_tileSize = static_cast<int>(GetIntegerProperty("tile_size"));
+    m_tileOverlap = static_cast<int>(GetIntegerProperty("tile_overlap"));
+    if (m_tileSize > 0 && (m_tileOverlap < 0 || m_tileOverlap >= m_tileSize))
+        Error("The tile overlap must be positive and smaller than the tile size.");
+
+    m_maxDetections = static_cast<int>(GetIntegerProperty("max_detections"));
+    if (m_maxDetections < 1)
+        Error("The maximum number of detections must be at least 1.");
+    for (const YoloInputOutputs& outputs : m_outputs)
+    {
+        outputs.boundingBoxes->AllocOutputBuffer(m_maxDetections);
+        if (outputs.labels)
+            outputs.labels->AllocOutputBuffer(m_maxDetections);
+        outputs.detections->AllocOutputBuffer(m_maxDetections * DETECTION_NB_FLOATS);
+    }
+
+    m_detectionInterval = static_cast<int>(GetIntegerProperty("detection_interval"));
+    if (m_detectionInterval < 1)
+        Error("The detection interval must be at least 1.");
+    m_frameCount = 0;
+
+    m_motionGating = GetBoolProperty("motion_gating");
+    m_motionCrop = m_motionGating && GetBoolProperty("motion_crop") && m_tileSize <= 0;
+    m_gatingGrays.assign(m_nbInputs, cv::Mat());
+    m_gatingRefs.assign(m_nbInputs, cv::Mat());
+    m_motionCrops.assign(m_nbInputs, cv::Rect());
+    m_lastDetections.assign(m_nbInputs, std::vector<YoloDetection>());
+    m_hasPendingDetections = false;
+    m_trackers.assign(m_nbInputs, YoloTracker());
+    m_trackScales.assign(m_nbInputs, 1.0);
+    m_fullGrays.assign(m_nbInputs, cv::Mat());
+    m_grays.assign(m_nbInputs, cv::Mat());
+    m_prevGrays.assign(m_nbInputs, cv::Mat());
+    m_pendingDetections.assign(m_nbInputs, std::vector<YoloDetection>());
+    m_pendingKeyGrays.assign(m_nbInputs, cv::Mat());
+
+    m_backend = GetIntegerProperty("backend") == BACKEND_OPENVINO ? cv::dnn::DNN_BACKEND_INFERENCE_ENGINE : cv::dnn::DNN_BACKEND_OPENCV;
+    switch (GetIntegerProperty("target"))
+    {
+    case TARGET_CPU_FP16:
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+        m_target = cv::dnn::DNN_TARGET_CPU_FP16;
+#else
+        Error("The CPU FP16 target requires OpenCV 4.9 or later.");
+#endif
+        break;
+    default:
+        m_target = cv::dnn::DNN_TARGET_CPU;
+        break;
+    }
+
+    //Fail early when OpenCV has not been built with the requested backend
+    const std::vector<cv::dnn::Target> targets = cv::dnn::getAvailableTargets(static_cast<cv::dnn::Backend>(m_backend));
+    if (std::find(targets.begin(), targets.end(), static_cast<cv::dnn::Target>(m_target)) == targets.end())
+        Error("The selected DNN backend and target are not available in this OpenCV build.");
+
+    //The number of threads is a process-wide OpenCV setting: it also applies to the other components
+    const int nbThreads = static_cast<int>(GetIntegerProperty("nb_threads"));
+    if (nbThreads > 0)
+        cv::setNumThreads(nbThreads);
+
+    //The model is loaded in the background (see LoadingThread): the images received until it is ready are dropped
+    //(see ProcessData)
+    StartPipeline(configPath, weightPath);
+
+    if (m_nbInputs == 1)
+    {
+        //Single camera: each image is processed as soon as it is received, as before
+        m_inputReader = MAPS::MakeInputReader::Reactive(
+            this,
+            MAPS::InputReaderOption::Reactive::FirstTimeBehavior::WaitForAllInputs,
+            MAPS::InputReaderOption::Reactive::Buffering::Enabled,
+            m_inputs,
+            &MAPSOpenCV_Yolo::AllocateOutputBufferSize,  // Called when data is received for the first time only
+            &MAPSOpenCV_Yolo::ProcessData      // Called when data is received for the first time AND all subsequent times
+        );
+    }
+    else
+    {
+        //The images of all the inputs are gathered in the same network batch
+        m_inputReader = MAPS::MakeInputReader::Synchronized(
+            this,
+            GetIntegerProperty("synchro_tolerance"),
+            MAPS::InputReaderOption::Synchronized::SyncBehavior::SyncAllInputs,
+            m_inputs,
+            &MAPSOpenCV_Yolo::AllocateOutputBufferSize,  // Called when data is received for the first time only
+            &MAPSOpenCV_Yolo::ProcessData      // Called when data is received for the first time AND all subsequent times
+        );
+    }
 }
 
 void MAPSOpenCV_Yolo::Core()
@@ -98,75 +640,901 @@ void MAPSOpenCV_Yolo::Core()
 
 void MAPSOpenCV_Yolo::Death()
 {
+    StopPipeline();
     m_inputReader.reset();
+    m_model.reset();
+}
+
+void MAPSOpenCV_Yolo::StartPipeline(const std::string& configPath, const std::string& weightPath)
+{
+    m_stopPipeline = false;
+    m_modelReady = false;
+    m_batchSize = 0;
+    m_pipelineError.clear();
+    m_freeBlobSlots.clear();
+    m_readyBlobSlots.clear();
+    m_freeOutputSlots.clear();
+    m_readyOutputSlots.clear();
+    for (int i = 0; i < YOLO_NB_SLOTS; i++)
+    {
+        m_freeBlobSlots.push_back(i);
+        m_freeOutputSlots.push_back(i);
+    }
+
+    m_loadingThread = std::thread(&MAPSOpenCV_Yolo::LoadingThread, this, configPath, weightPath);
+    m_inferenceThread = std::thread(&MAPSOpenCV_Yolo::InferenceThread, this);
+    m_decodingThread = std::thread(&MAPSOpenCV_Yolo::DecodingThread, this);
 }
 
-void MAPSOpenCV_Yolo::AllocateOutputBufferSize(const MAPSTimestamp, const MAPS::InputElt<IplImage> imageInElt)
+void MAPSOpenCV_Yolo::StopPipeline()
 {
-    const IplImage& imageIn = imageInElt.Data();
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineMutex);
+        m_stopPipeline = true;
+    }
+    m_pipelineCond.notify_all();
+
+    //A model being loaded cannot be interrupted: wait for the end of the loading
+    if (m_loadingThread.joinable())
+        m_loadingThread.join();
+    if (m_inferenceThread.joinable())
+        m_inferenceThread.join();
+    if (m_decodingThread.joinable())
+        m_decodingThread.join();
+}
+
+// Errors cannot be raised from the pipeline threads: they are reported on the component thread at the next image.
+void MAPSOpenCV_Yolo::SetPipelineError(const char* message)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineMutex);
+        if (m_pipelineError.empty())
+            m_pipelineError = message;
+        m_stopPipeline = true;
+    }
+    m_pipelineCond.notify_all();
+}
 
-    //Set the model inputs with the image size
-    m_model.setInputParams(1 / 255.0, cv::Size(imageIn.width, imageIn.height), cv::Scalar(), true);
+void MAPSOpenCV_Yolo::WriteStatus(const char* status)
+{
+    MAPS::OutputGuard<char> outGuard{ this, *m_statusOutput };
+    MAPS::Strcpy(&outGuard.Data(0), status);
+    outGuard.VectorSize() = static_cast<int>(strlen(status));
+    outGuard.Timestamp() = MAPS::CurrentTime();
 }
 
-void MAPSOpenCV_Yolo::ProcessData(const MAPSTimestamp ts, const MAPS::InputElt<IplImage> inElt)
+// Loads the network (or gets the one already loaded by another instance) and runs a first forward pass on a dummy
+// blob of the size of the real batches: the lazy initialization of the layers is done there rather than on the first
+// image. The batch size (tiles included) and the network input size are only known once the first images are received.
+void MAPSOpenCV_Yolo::LoadingThread(std::string configPath, std::string weightPath)
 {
     try
     {
-        const IplImage& imageIn = inElt.Data();
-		MAPS::OutputGuard<MAPSDrawingObject> outGuardBB{ this, Output(0) };
-		MAPS::OutputGuard<MAPSDrawingObject> outGuardLabels{ this, Output(1) };
+        WriteStatus("loading");
+        std::shared_ptr<YoloSharedModel> model = AcquireSharedModel(m_isOnnx ? std::string() : configPath, weightPath, m_isOnnx, m_inputSize, m_backend, m_target);
+
+        std::vector<int> blobShape;
+        {
+            std::unique_lock<std::mutex> lock(m_pipelineMutex);
+            m_pipelineCond.wait(lock, [this] { return m_stopPipeline || m_batchSize > 0; });
+            if (m_stopPipeline)
+                return;
+            blobShape = { m_batchSize, 3, m_netSize.height, m_netSize.width };
+        }
+
+        {
+            std::lock_guard<std::mutex> forwardLock(model->forwardMutex);
+            if (model->warmedUpShape != blobShape)
+            {
+                WriteStatus("warming up");
+                cv::Mat blob(static_cast<int>(blobShape.size()), blobShape.data(), CV_32F, cv::Scalar(0));
+                std::vector<cv::Mat> outs;
+                model->net.setInput(blob);
+                model->net.forward(outs, model->outNames);
+                model->warmedUpShape = blobShape;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_pipelineMutex);
+            m_model = model;
+            m_modelReady = true;
+        }
+        m_pipelineCond.notify_all();
+        WriteStatus("ready");
+    }
+    catch (const std::exception& e)
+    {
+        std::string status = std::string("error: ") + e.what();
+        WriteStatus(status.substr(0, 255).c_str());
+        SetPipelineError(e.what());
+    }
+}
+
+void MAPSOpenCV_Yolo::InferenceThread()
+{
+    try
+    {
+        std::vector<cv::Mat> outs;
+        double totalTime = 0;
+        std::unique_lock<std::mutex> lock(m_pipelineMutex);
+        for (;;)
+        {
+            m_pipelineCond.wait(lock, [this] { return m_stopPipeline || (m_modelReady && !m_readyBlobSlots.empty()); });
+            if (m_stopPipeline)
+                return;
+            const int blobIndex = m_readyBlobSlots.front();
+            m_readyBlobSlots.pop_front();
+            lock.unlock();
+
+            //Run the network, the component thread fills the other blob meanwhile.
+            //The network may be shared with other instances: one forward pass at a time, and the outputs
+            //(which reference the network internal buffers) are copied before another pass can run.
+            //Repeat slots (static scene) have no blob: they only go through the pipeline to keep the outputs in order.
+            const YoloBlobSlot& blobSlot = m_blobSlots[blobIndex];
+            const bool repeat = blobSlot.repeat;
+            if (!repeat)
+            {
+                std::lock_guard<std::mutex> forwardLock(m_model->forwardMutex);
+                m_model->net.setInput(blobSlot.blob);
+                m_model->net.forward(m_forwardOuts, m_model->outNames);
+                outs.resize(m_forwardOuts.size());
+                for (size_t i = 0; i < m_forwardOuts.size(); i++)
+                    m_forwardOuts[i].copyTo(outs[i]);
+                if (m_statsOutput)
+                {
+                    totalTime = static_cast<double>(m_model->net.getPerfProfile(m_layersTimes));
+                    if (m_layerNames.empty())
+                        m_layerNames = m_model->net.getLayerNames();
+                }
+            }
+            if (m_statsOutput && !repeat)
+                WriteStats(blobSlot.timestamps.empty() ? 0 : blobSlot.timestamps[0], m_layersTimes, totalTime);
+            m_transforms = blobSlot.transforms;
+            m_timestamps = blobSlot.timestamps;
+            m_keyGrays = blobSlot.keyGrays;
+            m_crops = blobSlot.crops;
+
+            lock.lock();
+            m_freeBlobSlots.push_back(blobIndex);
+            m_pipelineCond.wait(lock, [this] { return m_stopPipeline || !m_freeOutputSlots.empty(); });
+            if (m_stopPipeline)
+                return;
+            const int outputIndex = m_freeOutputSlots.front();
+            m_freeOutputSlots.pop_front();
+
+            //Swap rather than copy: the output matrices of the previous frame are reused by the next copy
+            YoloOutputSlot& outputSlot = m_outputSlots[outputIndex];
+            outputSlot.repeat = repeat;
+            outputSlot.outs.swap(outs);
+            outputSlot.transforms.swap(m_transforms);
+            outputSlot.timestamps.swap(m_timestamps);
+            outputSlot.keyGrays.swap(m_keyGrays);
+            outputSlot.crops.swap(m_crops);
+            m_readyOutputSlots.push_back(outputIndex);
+            m_pipelineCond.notify_all();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        SetPipelineError(e.what());
+    }
+}
+
+void MAPSOpenCV_Yolo::DecodingThread()
+{
+    try
+    {
+        std::unique_lock<std::mutex> lock(m_pipelineMutex);
+        for (;;)
+        {
+            m_pipelineCond.wait(lock, [this] { return m_stopPipeline || !m_readyOutputSlots.empty(); });
+            if (m_stopPipeline)
+                return;
+            const int outputIndex = m_readyOutputSlots.front();
+            m_readyOutputSlots.pop_front();
+            lock.unlock();
+
+            const YoloOutputSlot& outputSlot = m_outputSlots[outputIndex];
+            if (outputSlot.repeat)
+            {
+                //Static scene: the previous detections are output again with the timestamps of the current images
+                for (int i = 0; i < m_nbInputs; i++)
+                    WriteDetections(outputSlot.timestamps[i], i, m_lastDetections[i]);
+
+                lock.lock();
+                m_freeOutputSlots.push_back(outputIndex);
+                m_pipelineCond.notify_all();
+                continue;
+            }
+
+            float conf_thres = static_cast<float>(GetFloatProperty("confidence_threshold"));
+            float nms_thres = static_cast<float>(GetFloatProperty("nms_threshold"));
+
+            //Detect the known objects in each input image with a dedicated box and confidence score:
+            //the detections of all the tiles of an image are merged by a single NMS
+            for (int i = 0; i < m_nbInputs; i++)
+            {
+                m_candidates.clear();
+                for (int entry = m_inputFirstEntry[i]; entry < m_inputFirstEntry[i + 1]; entry++)
+                {
+                    const size_t first = m_candidates.size();
+                    DecodeOutputs(outputSlot.outs, entry, outputSlot.transforms[entry], conf_thres, m_candidates);
+                    if (m_batchRegions[entry] != m_imageRegions[i])
+                        DiscardCutDetections(m_batchRegions[entry], m_imageRegions[i], first, m_candidates);
+                }
+                NMSPerClass(m_candidates, conf_thres, nms_thres, m_detections);
+
+                const cv::Rect& crop = outputSlot.crops[i];
+                if (crop.area() > 0)
+                    MergeCropDetections(crop, m_lastDetections[i], m_detections);
+                m_lastDetections[i] = m_detections;
+
+                if (m_detectionInterval > 1)
+                {
+                    //Tracking mode: the outputs are written by the component thread at each image
+                    std::lock_guard<std::mutex> pendingLock(m_pipelineMutex);
+                    m_pendingDetections[i] = m_detections;
+                    m_pendingKeyGrays[i] = outputSlot.keyGrays[i];
+                    m_hasPendingDetections = true;
+                }
+                else
+                {
+                    WriteDetections(outputSlot.timestamps[i], i, m_detections);
+                }
+            }
+
+            lock.lock();
+            m_freeOutputSlots.push_back(outputIndex);
+            m_pipelineCond.notify_all();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        SetPipelineError(e.what());
+    }
+}
+
+void MAPSOpenCV_Yolo::AllocateOutputBufferSize(const MAPSTimestamp, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    //All the images go through the same blob, hence the same color order is required on all the inputs
+    const MAPSInt32 chanSeq = *(MAPSInt32*)inElts[0].Data().channelSeq;
+    for (int i = 0; i < m_nbInputs; i++)
+    {
+        const IplImage& imageIn = inElts[i].Data();
+        if (imageIn.depth != IPL_DEPTH_8U || (*(MAPSInt32*)imageIn.channelSeq != MAPS_CHANNELSEQ_RGB && *(MAPSInt32*)imageIn.channelSeq != MAPS_CHANNELSEQ_BGR))
+            Error("This component only accepts 8 bits RGB or BGR images.");
+        if (*(MAPSInt32*)imageIn.channelSeq != chanSeq)
+            Error("All the inputs must have the same color format (RGB or BGR).");
+    }
+
+    //The network expects RGB images
+    m_swapRB = chanSeq == MAPS_CHANNELSEQ_BGR;
+
+    //Network input size: full image size unless specified (size of the first input with several inputs)
+    const IplImage& firstImage = inElts[0].Data();
+    m_netSize.width = m_inputSize.width > 0 ? m_inputSize.width : firstImage.width;
+    m_netSize.height = m_inputSize.height > 0 ? m_inputSize.height : firstImage.height;
+
+    //Batch entries: for each input, the full image, followed by the tiles when tiling is enabled
+    m_imageRegions.clear();
+    m_batchRegions.clear();
+    m_inputFirstEntry.assign(1, 0);
+    for (int i = 0; i < m_nbInputs; i++)
+    {
+        const IplImage& imageIn = inElts[i].Data();
+        const cv::Rect imageRegion(0, 0, imageIn.width, imageIn.height);
+        m_imageRegions.push_back(imageRegion);
+        m_batchRegions.push_back(imageRegion);
+
+        if (m_tileSize > 0 && (imageIn.width > m_tileSize || imageIn.height > m_tileSize))
+        {
+            std::vector<int> xs, ys;
+            ComputeTileStarts(imageIn.width, m_tileSize, m_tileOverlap, xs);
+            ComputeTileStarts(imageIn.height, m_tileSize, m_tileOverlap, ys);
+            for (int y : ys)
+            {
+                for (int x : xs)
+                    m_batchRegions.push_back(cv::Rect(x, y, MIN(m_tileSize, imageIn.width), MIN(m_tileSize, imageIn.height)));
+            }
+        }
+        m_inputFirstEntry.push_back(static_cast<int>(m_batchRegions.size()));
+    }
+    m_batchInputs.resize(m_batchRegions.size());
+    for (int i = 0; i < m_nbInputs; i++)
+        std::fill(m_batchInputs.begin() + m_inputFirstEntry[i], m_batchInputs.begin() + m_inputFirstEntry[i + 1], i);
+
+    //The letterbox borders are filled once and for all, only the resized image is written at each frame
+    m_netImages.resize(m_batchRegions.size());
+    for (cv::Mat& netImage : m_netImages)
+    {
+        netImage.create(m_netSize, CV_8UC3);
+        netImage.setTo(cv::Scalar::all(LETTERBOX_PAD_VALUE));
+    }
+    m_batchImages.resize(m_batchRegions.size());
+    m_letterboxRects.assign(m_batchRegions.size(), cv::Rect());
+
+    //The loading thread waits for the batch shape to warm the network up
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineMutex);
+        m_batchSize = static_cast<int>(m_batchRegions.size());
+    }
+    m_pipelineCond.notify_all();
+}
+
+// The network ran on the crop only: the previous detections outside the crop still stand. The objects are
+// split between the crop and the rest of the image according to their center.
+void MAPSOpenCV_Yolo::MergeCropDetections(const cv::Rect& crop, const std::vector<YoloDetection>& previous, std::vector<YoloDetection>& detections)
+{
+    auto centerInCrop = [&](const YoloDetection& d)
+    {
+        return crop.contains(cv::Point(d.box.x + d.box.width / 2, d.box.y + d.box.height / 2));
+    };
+    detections.erase(std::remove_if(detections.begin(), detections.end(), [&](const YoloDetection& d) { return !centerInCrop(d); }), detections.end());
+    for (const YoloDetection& d : previous)
+    {
+        if (!centerInCrop(d))
+            detections.push_back(d);
+    }
+}
+
+// Compares heavily downsampled gray images with the ones the network last ran on. Returns false when nothing moved
+// in any input; otherwise, with motion_crop, m_motionCrops gets the region to run the network on for each input.
+bool MAPSOpenCV_Yolo::DetectMotion(const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    const int threshold = static_cast<int>(GetIntegerProperty("motion_threshold"));
+    const int minPixels = static_cast<int>(GetIntegerProperty("motion_min_pixels"));
 
+    bool moved = false;
+    for (int i = 0; i < m_nbInputs; i++)
+    {
+        const IplImage& imageIn = inElts[i].Data();
         cv::Mat cvImageIn = convTools::noCopyIplImage2Mat(&imageIn);
+        const int width = MIN(GATING_WIDTH, imageIn.width);
+        const int height = MAX(1, cvRound(static_cast<double>(imageIn.height) * width / imageIn.width));
+        cv::resize(cvImageIn, m_gatingColor, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+        cv::cvtColor(m_gatingColor, m_gatingGrays[i], m_swapRB ? cv::COLOR_BGR2GRAY : cv::COLOR_RGB2GRAY);
 
-        std::vector<int> classIds;
-        std::vector<float> scores;
-        std::vector<cv::Rect> boxes;
-        float conf_thres = static_cast<float>(GetFloatProperty("confidence_threshold"));
-        float nms_thres = static_cast<float>(GetFloatProperty("nms_threshold"));
+        m_motionCrops[i] = cv::Rect();
+        if (m_gatingRefs[i].empty())
+        {
+            moved = true;
+            continue;
+        }
 
-		// Create a new image using the data of the input image, the new size and the interpollation method choose
-		//Detect the known objects in the image with a dedicated box and confidence score
-		m_model.detect(cvImageIn, classIds, scores, boxes, conf_thres, nms_thres);
+        cv::absdiff(m_gatingGrays[i], m_gatingRefs[i], m_gatingDiff);
+        cv::threshold(m_gatingDiff, m_gatingDiff, threshold, 255, cv::THRESH_BINARY);
+        if (cv::countNonZero(m_gatingDiff) < minPixels)
+            continue;
+        moved = true;
 
-        //For all the detected objetcs
-        int n_objs = MIN(static_cast<int>(classIds.size()), MAX_DOBJS_OUT);
-        for (int i = 0; i < n_objs; i++) {
+        if (m_motionCrop)
+        {
+            //Motion region in image coordinates, with some margin, extended to the network aspect ratio
+            //and to the network size at least so that the crop is never upscaled
+            const double scale = static_cast<double>(imageIn.width) / width;
+            const cv::Rect motion = cv::boundingRect(m_gatingDiff);
+            double cropW = (motion.width * scale) + 2 * GATING_CROP_MARGIN * imageIn.width;
+            double cropH = (motion.height * scale) + 2 * GATING_CROP_MARGIN * imageIn.height;
+            const double netAspect = static_cast<double>(m_netSize.width) / m_netSize.height;
+            if (cropW / cropH < netAspect)
+                cropW = cropH * netAspect;
+            else
+                cropH = cropW / netAspect;
+            cropW = MIN(static_cast<double>(imageIn.width), MAX(cropW, static_cast<double>(m_netSize.width)));
+            cropH = MIN(static_cast<double>(imageIn.height), MAX(cropH, static_cast<double>(m_netSize.height)));
 
-            std::string label = cv::format("%.2f", scores[i]);
-            label = m_classes[classIds[i]] + ":" + label;
-
-			MAPSDrawingObject& bb = outGuardBB.Data(i);
-			MAPS::Memset(&bb, 0, sizeof(MAPSDrawingObject));
-			bb.kind = MAPSDrawingObject::Rectangle;
-			bb.id = classIds[i];
-			bb.color = MAPS_RGB(s_label_colors[classIds[i] % NB_LABEL_COLORS][0], s_label_colors[classIds[i] % NB_LABEL_COLORS][1], s_label_colors[classIds[i] % NB_LABEL_COLORS][2]);
-			bb.width = 2;
-			bb.rectangle.x1 = boxes[i].x;
-			bb.rectangle.x2 = boxes[i].width + boxes[i].x;
-			bb.rectangle.y1 = boxes[i].y;
-			bb.rectangle.y2 = boxes[i].y + boxes[i].height;
-
-			MAPSDrawingObject& label_dobj = outGuardLabels.Data(i);
-			MAPS::Memset(&label_dobj, 0, sizeof(MAPSDrawingObject));
-			label_dobj.kind = MAPSDrawingObject::Text;
-			label_dobj.id = classIds[i];
-			label_dobj.color = bb.color;
-			label_dobj.width = 2;
-			label_dobj.text.x = bb.rectangle.x1 + 10;
-			label_dobj.text.y = bb.rectangle.y1 + 10;
-			label_dobj.text.cheight = 10;
-			label_dobj.text.cwidth = 10;
-			MAPS::Strcpy(label_dobj.text.text, label.c_str());
-        }
-
-		outGuardBB.VectorSize() = n_objs;
-		outGuardLabels.VectorSize() = n_objs;
-		outGuardBB.Timestamp() = ts;
-		outGuardLabels.Timestamp() = ts;
+            const double cx = (motion.x + motion.width / 2.0) * scale;
+            const double cy = (motion.y + motion.height / 2.0) * scale;
+            const int x = cvRound(MIN(MAX(cx - cropW / 2, 0.0), imageIn.width - cropW));
+            const int y = cvRound(MIN(MAX(cy - cropH / 2, 0.0), imageIn.height - cropH));
+            const cv::Rect crop = cv::Rect(x, y, cvRound(cropW), cvRound(cropH)) & m_imageRegions[i];
+            if (crop != m_imageRegions[i])
+                m_motionCrops[i] = crop;
+        }
+    }
+
+    //The next images are compared to the ones the network runs on
+    if (moved)
+    {
+        for (int i = 0; i < m_nbInputs; i++)
+            cv::swap(m_gatingRefs[i], m_gatingGrays[i]);
+    }
+    return moved;
+}
+
+// Static scene: the previous detections are output again with the timestamps of the current images. The outputs are
+// only written by the decoding thread, after the detections of the images already in the pipeline: a repeat slot
+// without blob is queued.
+void MAPSOpenCV_Yolo::RepeatDetections(const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    const int blobIndex = AcquireBlobSlot();
+    YoloBlobSlot& slot = m_blobSlots[blobIndex];
+    slot.repeat = true;
+    slot.timestamps.resize(m_nbInputs);
+    for (int i = 0; i < m_nbInputs; i++)
+        slot.timestamps[i] = inElts[i].Timestamp();
+    slot.transforms.clear();
+    slot.keyGrays.assign(m_nbInputs, cv::Mat());
+    slot.crops.assign(m_nbInputs, cv::Rect());
+    PushBlobSlot(blobIndex);
+}
+
+// Removes the detections of a tile (from index first) touching a tile border which is inside the image
+void MAPSOpenCV_Yolo::DiscardCutDetections(const cv::Rect& tile, const cv::Rect& image, size_t first, std::vector<YoloDetection>& detections)
+{
+    const bool innerLeft = tile.x > image.x;
+    const bool innerTop = tile.y > image.y;
+    const bool innerRight = tile.x + tile.width < image.x + image.width;
+    const bool innerBottom = tile.y + tile.height < image.y + image.height;
+
+    auto isCut = [&](const YoloDetection& d)
+    {
+        return (innerLeft && d.box.x <= tile.x + TILE_BORDER_MARGIN) ||
+            (innerTop && d.box.y <= tile.y + TILE_BORDER_MARGIN) ||
+            (innerRight && d.box.x + d.box.width >= tile.x + tile.width - TILE_BORDER_MARGIN) ||
+            (innerBottom && d.box.y + d.box.height >= tile.y + tile.height - TILE_BORDER_MARGIN);
+    };
+    detections.erase(std::remove_if(detections.begin() + first, detections.end(), isCut), detections.end());
+}
+
+// Resizes the image (or tile) of one batch entry to the network input size, the result is referenced by m_batchImages[batchIndex]
+void MAPSOpenCV_Yolo::PrepareNetImage(const cv::Mat& imageIn, int batchIndex, YoloBlobTransform& transform)
+{
+    cv::Mat& netBuffer = m_netImages[batchIndex];
+    cv::Mat& netImage = m_batchImages[batchIndex];
+    netImage = netBuffer;
+    if (imageIn.size() == m_netSize)
+    {
+        netImage = imageIn;
+        transform.scaleX = transform.scaleY = 1.0;
+        transform.offsetX = transform.offsetY = 0.0;
+    }
+    else if (m_resizeMode == RESIZE_MODE_LETTERBOX)
+    {
+        //Keep the aspect ratio, center the image and pad the borders
+        const double scale = MIN(static_cast<double>(m_netSize.width) / imageIn.cols, static_cast<double>(m_netSize.height) / imageIn.rows);
+        const int width = MIN(m_netSize.width, cvRound(imageIn.cols * scale));
+        const int height = MIN(m_netSize.height, cvRound(imageIn.rows * scale));
+        const int padX = (m_netSize.width - width) / 2;
+        const int padY = (m_netSize.height - height) / 2;
+
+        //The borders only need to be cleared when the letterbox geometry changes (motion crops)
+        const cv::Rect letterbox(padX, padY, width, height);
+        if (letterbox != m_letterboxRects[batchIndex])
+        {
+            netBuffer.setTo(cv::Scalar::all(LETTERBOX_PAD_VALUE));
+            m_letterboxRects[batchIndex] = letterbox;
+        }
+        cv::Mat roi = netBuffer(letterbox);
+        cv::resize(imageIn, roi, roi.size(), 0, 0, cv::INTER_LINEAR);
+
+        transform.scaleX = transform.scaleY = 1.0 / scale;
+        transform.offsetX = -padX / scale;
+        transform.offsetY = -padY / scale;
+    }
+    else
+    {
+        cv::resize(imageIn, netBuffer, m_netSize, 0, 0, cv::INTER_LINEAR);
+        transform.scaleX = static_cast<double>(imageIn.cols) / m_netSize.width;
+        transform.scaleY = static_cast<double>(imageIn.rows) / m_netSize.height;
+        transform.offsetX = transform.offsetY = 0.0;
+    }
+}
+
+void MAPSOpenCV_Yolo::DecodeOutputs(const std::vector<cv::Mat>& outs, int batchIndex, const YoloBlobTransform& transform, float confThreshold, std::vector<YoloDetection>& detections)
+{
+    for (const cv::Mat& batchOut : outs)
+    {
+        if (!m_isOnnx)
+        {
+            //Darknet region layers: one row per candidate box, [center x, center y, width, height, objectness, class scores...]
+            //with coordinates relative to the network input size, and class scores already weighted by the objectness.
+            //With a batch of several images, the output is 3D [image, box, values].
+            const cv::Mat out = batchOut.dims == 3 ? cv::Mat(batchOut.size[1], batchOut.size[2], CV_32F, const_cast<float*>(batchOut.ptr<float>(batchIndex))) : batchOut;
+            DecodeRows(out, cv::Size2d(m_netSize.width, m_netSize.height), transform, confThreshold, detections);
+            continue;
+        }
+
+        if (batchOut.dims != 3)
+            CV_Error(cv::Error::StsNotImplemented, "Unsupported ONNX output layout: a 3D output [batch, boxes, values] (YOLOv5) or [batch, values, boxes] (YOLOv8) is expected.");
+
+        //ONNX exports: coordinates in network input pixels. There are always far more boxes than values per box,
+        //which tells the YOLOv5 layout [boxes, 5 + classes] from the YOLOv8 one [4 + classes, boxes] (no objectness).
+        const cv::Mat out(batchOut.size[1], batchOut.size[2], CV_32F, const_cast<float*>(batchOut.ptr<float>(batchIndex)));
+        if (out.rows > out.cols)
+            DecodeRows(out, cv::Size2d(1.0, 1.0), transform, confThreshold, detections);
+        else
+            DecodeColumns(out, transform, confThreshold, detections);
+    }
+}
+
+// Greatest class score of a box and its class index
+static float MaxClassScore(const float* scores, int nbClasses, int& classId)
+{
+    int i = 0;
+    float maxScore = -FLT_MAX;
+#if CV_SIMD128
+    if (nbClasses >= 4)
+    {
+        cv::v_float32x4 vmax = cv::v_load(scores);
+        for (i = 4; i <= nbClasses - 4; i += 4)
+            vmax = cv::v_max(vmax, cv::v_load(scores + i));
+        maxScore = cv::v_reduce_max(vmax);
+    }
+#endif
+    for (; i < nbClasses; i++)
+        maxScore = MAX(maxScore, scores[i]);
+    classId = static_cast<int>(std::find(scores, scores + nbClasses, maxScore) - scores);
+    return maxScore;
+}
+
+static YoloDetection MakeDetection(int classId, float score, double cx, double cy, double w, double h, const YoloBlobTransform& transform)
+{
+    const double width = w * transform.scaleX;
+    const double height = h * transform.scaleY;
+    const double left = cx * transform.scaleX + transform.offsetX - width / 2;
+    const double top = cy * transform.scaleY + transform.offsetY - height / 2;
+
+    YoloDetection d;
+    d.classId = classId;
+    d.score = score;
+    d.box = cv::Rect(cvRound(left), cvRound(top), cvRound(width), cvRound(height));
+    d.trackId = -1;
+    return d;
+}
+
+// One row per box: [center x, center y, width, height, objectness, class scores...] (darknet, YOLOv5)
+void MAPSOpenCV_Yolo::DecodeRows(const cv::Mat& out, const cv::Size2d& coordScale, const YoloBlobTransform& transform, float confThreshold, std::vector<YoloDetection>& detections)
+{
+    const int nbClasses = out.cols - 5;
+    const bool weightedScores = !m_isOnnx; // darknet class scores are already multiplied by the objectness
+    for (int row = 0; row < out.rows; row++)
+    {
+        const float* data = out.ptr<float>(row);
+
+        //The score is at most the objectness: most of the rows are rejected here without looking at the class scores
+        const float obj = data[4];
+        if (obj < confThreshold)
+            continue;
+
+        int classId;
+        float score = MaxClassScore(data + 5, nbClasses, classId);
+        if (!weightedScores)
+            score *= obj;
+        if (score < confThreshold)
+            continue;
+
+        detections.push_back(MakeDetection(classId, score, data[0] * coordScale.width, data[1] * coordScale.height,
+            data[2] * coordScale.width, data[3] * coordScale.height, transform));
+    }
+}
+
+// One column per box: [center x, center y, width, height, class scores...] rows (YOLOv8).
+// The class scores of consecutive boxes are contiguous: the best class is searched for 4 boxes at once,
+// scanning the output row by row.
+void MAPSOpenCV_Yolo::DecodeColumns(const cv::Mat& out, const YoloBlobTransform& transform, float confThreshold, std::vector<YoloDetection>& detections)
+{
+    const int nbBoxes = out.cols;
+    const int nbClasses = out.rows - 4;
+    if (nbClasses <= 0)
+        return;
+
+    m_maxScores.resize(nbBoxes);
+    m_classIds.resize(nbBoxes);
+    float* maxScores = m_maxScores.data();
+    int* classIds = m_classIds.data();
+
+    std::copy(out.ptr<float>(4), out.ptr<float>(4) + nbBoxes, maxScores);
+    std::fill(classIds, classIds + nbBoxes, 0);
+    for (int c = 1; c < nbClasses; c++)
+    {
+        const float* scores = out.ptr<float>(4 + c);
+        int j = 0;
+#if CV_SIMD128
+        const cv::v_int32x4 v_c = cv::v_setall_s32(c);
+        for (; j <= nbBoxes - 4; j += 4)
+        {
+            cv::v_float32x4 v = cv::v_load(scores + j);
+            cv::v_float32x4 vmax = cv::v_load(maxScores + j);
+            cv::v_float32x4 greater = v > vmax;
+            cv::v_store(maxScores + j, cv::v_select(greater, v, vmax));
+            cv::v_store(classIds + j, cv::v_select(cv::v_reinterpret_as_s32(greater), v_c, cv::v_load(classIds + j)));
+        }
+#endif
+        for (; j < nbBoxes; j++)
+        {
+            if (scores[j] > maxScores[j])
+            {
+                maxScores[j] = scores[j];
+                classIds[j] = c;
+            }
+        }
+    }
+
+    const float* cx = out.ptr<float>(0);
+    const float* cy = out.ptr<float>(1);
+    const float* w = out.ptr<float>(2);
+    const float* h = out.ptr<float>(3);
+    int j = 0;
+#if CV_SIMD128
+    const cv::v_float32x4 v_thres = cv::v_setall_f32(confThreshold);
+    for (; j <= nbBoxes - 4; j += 4)
+    {
+        //Skip 4 boxes at once when none of them reaches the threshold
+        if (!cv::v_check_any(cv::v_load(maxScores + j) >= v_thres))
+            continue;
+        for (int k = j; k < j + 4; k++)
+        {
+            if (maxScores[k] >= confThreshold)
+                detections.push_back(MakeDetection(classIds[k], maxScores[k], cx[k], cy[k], w[k], h[k], transform));
+        }
+    }
+#endif
+    for (; j < nbBoxes; j++)
+    {
+        if (maxScores[j] >= confThreshold)
+            detections.push_back(MakeDetection(classIds[j], maxScores[j], cx[j], cy[j], w[j], h[j], transform));
+    }
+}
+
+void MAPSOpenCV_Yolo::ProcessData(const MAPSTimestamp, const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    bool modelReady;
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineMutex);
+        if (!m_pipelineError.empty())
+            Error(m_pipelineError.c_str());
+        modelReady = m_modelReady;
+    }
+
+    try
+    {
+        if (m_detectionInterval > 1)
+        {
+            //Small gray images for the optical flow
+            for (int i = 0; i < m_nbInputs; i++)
+            {
+                const IplImage& imageIn = inElts[i].Data();
+                cv::Mat cvImageIn = convTools::noCopyIplImage2Mat(&imageIn);
+                m_trackScales[i] = MIN(1.0, static_cast<double>(TRACKING_MAX_WIDTH) / imageIn.width);
+                cv::cvtColor(cvImageIn, m_fullGrays[i], m_swapRB ? cv::COLOR_BGR2GRAY : cv::COLOR_RGB2GRAY);
+                m_grays[i] = cv::Mat(); // new buffer: the previous one may be referenced by the pipeline as a key image
+                cv::resize(m_fullGrays[i], m_grays[i], cv::Size(), m_trackScales[i], m_trackScales[i], cv::INTER_AREA);
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        Error(e.what());
+    }
+
+    //The network only runs on one image out of m_detectionInterval, and only when something moved with motion gating.
+    //The images received while the model is loading are dropped rather than queued: they would be processed late.
+    bool runNetwork = m_frameCount++ % m_detectionInterval == 0 && modelReady;
+    if (runNetwork && m_motionGating)
+    {
+        try
+        {
+            runNetwork = DetectMotion(inElts);
+        }
+        catch (std::exception& e)
+        {
+            Error(e.what());
+        }
+        if (!runNetwork && m_detectionInterval == 1)
+            RepeatDetections(inElts);
+    }
+    if (runNetwork)
+        EnqueueBatch(inElts);
+
+    if (m_detectionInterval > 1)
+        UpdateTracks(inElts);
+}
+
+int MAPSOpenCV_Yolo::AcquireBlobSlot()
+{
+    std::lock_guard<std::mutex> lock(m_pipelineMutex);
+
+    //Never wait for the inference thread: when both blobs are busy, the oldest blob not yet
+    //processed is dropped and refilled with the current images.
+    int blobIndex;
+    if (!m_freeBlobSlots.empty())
+    {
+        blobIndex = m_freeBlobSlots.front();
+        m_freeBlobSlots.pop_front();
+    }
+    else
+    {
+        blobIndex = m_readyBlobSlots.front();
+        m_readyBlobSlots.pop_front();
+    }
+    return blobIndex;
+}
+
+void MAPSOpenCV_Yolo::PushBlobSlot(int blobIndex)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineMutex);
+        m_readyBlobSlots.push_back(blobIndex);
+    }
+    m_pipelineCond.notify_all();
+}
+
+void MAPSOpenCV_Yolo::EnqueueBatch(const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    const int blobIndex = AcquireBlobSlot();
+
+    try
+    {
+        YoloBlobSlot& slot = m_blobSlots[blobIndex];
+        slot.repeat = false;
+        const int nbEntries = static_cast<int>(m_batchRegions.size());
+        slot.transforms.resize(nbEntries);
+        slot.timestamps.resize(m_nbInputs);
+        slot.keyGrays = m_grays;
+        slot.crops.assign(m_nbInputs, cv::Rect());
+        if (m_motionCrop)
+            slot.crops = m_motionCrops;
+        m_cvImagesIn.resize(m_nbInputs);
+        for (int i = 0; i < m_nbInputs; i++)
+        {
+            const IplImage& imageIn = inElts[i].Data();
+            m_cvImagesIn[i] = convTools::noCopyIplImage2Mat(&imageIn);
+            slot.timestamps[i] = inElts[i].Timestamp();
+        }
+
+        //Resize the images (and tiles) to the network input size in parallel: the batch entries are independent
+        cv::parallel_for_(cv::Range(0, nbEntries), [&](const cv::Range& range)
+        {
+            for (int entry = range.start; entry < range.end; entry++)
+            {
+                const int input = m_batchInputs[entry];
+                const cv::Rect& region = slot.crops[input].area() > 0 ? slot.crops[input] : m_batchRegions[entry];
+                YoloBlobTransform& transform = slot.transforms[entry];
+                PrepareNetImage(m_cvImagesIn[input](region), entry, transform);
+                transform.offsetX += region.x;
+                transform.offsetY += region.y;
+            }
+        });
+
+        //Fill the network input blob with the whole batch, written in the blob allocated at the first frame (same size at each frame)
+        cv::dnn::blobFromImages(m_batchImages, slot.blob, 1 / 255.0, cv::Size(), cv::Scalar(), m_swapRB, false);
     }
     catch (std::exception& e)
     {
         Error(e.what());
     }
+
+    PushBlobSlot(blobIndex);
+}
+
+void MAPSOpenCV_Yolo::UpdateTracks(const MAPS::ArrayView<MAPS::InputElt<IplImage>> inElts)
+{
+    //Detections computed by the network since the previous image
+    bool hasNewDetections;
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineMutex);
+        hasNewDetections = m_hasPendingDetections;
+        if (hasNewDetections)
+        {
+            m_newDetections.swap(m_pendingDetections);
+            m_newKeyGrays.swap(m_pendingKeyGrays);
+            m_pendingDetections.assign(m_nbInputs, std::vector<YoloDetection>());
+            m_pendingKeyGrays.assign(m_nbInputs, cv::Mat());
+            m_hasPendingDetections = false;
+        }
+    }
+
+    try
+    {
+        for (int i = 0; i < m_nbInputs; i++)
+        {
+            YoloTracker& tracker = m_trackers[i];
+            if (!m_prevGrays[i].empty())
+                tracker.Track(m_prevGrays[i], m_grays[i], m_trackScales[i]);
+            if (hasNewDetections && !m_newKeyGrays[i].empty())
+                tracker.Update(m_newDetections[i], m_newKeyGrays[i], m_grays[i], m_trackScales[i]);
+            m_prevGrays[i] = m_grays[i];
+
+            tracker.GetDetections(m_trackedDetections);
+            WriteDetections(inElts[i].Timestamp(), i, m_trackedDetections);
+        }
+    }
+    catch (std::exception& e)
+    {
+        Error(e.what());
+    }
+}
+
+void MAPSOpenCV_Yolo::WriteDetections(const MAPSTimestamp ts, int inputIndex, const std::vector<YoloDetection>& detections)
+{
+    const YoloInputOutputs& outputs = m_outputs[inputIndex];
+    const int n_objs = MIN(static_cast<int>(detections.size()), m_maxDetections);
+
+    //Packed detections: class, score, x1, y1, x2, y2
+    {
+        MAPS::OutputGuard<MAPSFloat32> outGuardDetections{ this, *outputs.detections };
+        for (int i = 0; i < n_objs; i++)
+        {
+            const YoloDetection& d = detections[i];
+            MAPSFloat32* packed = &outGuardDetections.Data(i * DETECTION_NB_FLOATS);
+            packed[0] = static_cast<MAPSFloat32>(d.classId);
+            packed[1] = d.score;
+            packed[2] = static_cast<MAPSFloat32>(d.box.x);
+            packed[3] = static_cast<MAPSFloat32>(d.box.y);
+            packed[4] = static_cast<MAPSFloat32>(d.box.x + d.box.width);
+            packed[5] = static_cast<MAPSFloat32>(d.box.y + d.box.height);
+        }
+        outGuardDetections.VectorSize() = n_objs * DETECTION_NB_FLOATS;
+        outGuardDetections.Timestamp() = ts;
+    }
+
+    //For all the detected objetcs
+    {
+        MAPS::OutputGuard<MAPSDrawingObject> outGuardBB{ this, *outputs.boundingBoxes };
+        for (int i = 0; i < n_objs; i++) {
+            const YoloDetection& d = detections[i];
+
+            MAPSDrawingObject& bb = outGuardBB.Data(i);
+            MAPS::Memset(&bb, 0, sizeof(MAPSDrawingObject));
+            bb.kind = MAPSDrawingObject::Rectangle;
+            bb.id = d.trackId >= 0 ? d.trackId : d.classId;
+            bb.color = MAPS_RGB(s_label_colors[d.classId % NB_LABEL_COLORS][0], s_label_colors[d.classId % NB_LABEL_COLORS][1], s_label_colors[d.classId % NB_LABEL_COLORS][2]);
+            bb.width = 2;
+            bb.rectangle.x1 = d.box.x;
+            bb.rectangle.x2 = d.box.width + d.box.x;
+            bb.rectangle.y1 = d.box.y;
+            bb.rectangle.y2 = d.box.y + d.box.height;
+        }
+        outGuardBB.VectorSize() = n_objs;
+        outGuardBB.Timestamp() = ts;
+    }
+
+    //The labels are only formatted when the labels output exists
+    if (outputs.labels)
+    {
+        MAPS::OutputGuard<MAPSDrawingObject> outGuardLabels{ this, *outputs.labels };
+        for (int i = 0; i < n_objs; i++) {
+            const YoloDetection& d = detections[i];
+
+            MAPSDrawingObject& label_dobj = outGuardLabels.Data(i);
+            MAPS::Memset(&label_dobj, 0, sizeof(MAPSDrawingObject));
+            label_dobj.kind = MAPSDrawingObject::Text;
+            label_dobj.id = d.trackId >= 0 ? d.trackId : d.classId;
+            label_dobj.color = MAPS_RGB(s_label_colors[d.classId % NB_LABEL_COLORS][0], s_label_colors[d.classId % NB_LABEL_COLORS][1], s_label_colors[d.classId % NB_LABEL_COLORS][2]);
+            label_dobj.width = 2;
+            label_dobj.text.x = d.box.x + 10;
+            label_dobj.text.y = d.box.y + 10;
+            label_dobj.text.cheight = 10;
+            label_dobj.text.cwidth = 10;
+            const char* className = d.classId < static_cast<int>(m_classes.size()) ? m_classes[d.classId].c_str() : "";
+            snprintf(label_dobj.text.text, sizeof(label_dobj.text.text), "%s:%.2f", className, d.score);
+        }
+        outGuardLabels.VectorSize() = n_objs;
+        outGuardLabels.Timestamp() = ts;
+    }
+}
+
+// Per-layer timings of the last forward pass, slowest layers first
+void MAPSOpenCV_Yolo::WriteStats(MAPSTimestamp ts, const std::vector<double>& layersTimes, double totalTime)
+{
+    const double msPerTick = 1000.0 / cv::getTickFrequency();
+    m_statsOrder.resize(layersTimes.size());
+    for (size_t i = 0; i < m_statsOrder.size(); i++)
+        m_statsOrder[i] = static_cast<int>(i);
+    std::sort(m_statsOrder.begin(), m_statsOrder.end(), [&](int a, int b) { return layersTimes[a] > layersTimes[b]; });
+
+    MAPS::OutputGuard<char> outGuard{ this, *m_statsOutput };
+    char* text = &outGuard.Data(0);
+    int length = snprintf(text, STATS_MAX_SIZE, "total: %.3f ms\n", totalTime * msPerTick);
+    for (int layer : m_statsOrder)
+    {
+        if (length >= STATS_MAX_SIZE - 1)
+            break;
+        const char* name = layer < static_cast<int>(m_layerNames.size()) ? m_layerNames[layer].c_str() : "?";
+        length += snprintf(text + length, STATS_MAX_SIZE - length, "%s: %.3f ms\n", name, layersTimes[layer] * msPerTick);
+    }
+    outGuard.VectorSize() = MIN(length, STATS_MAX_SIZE - 1);
+    outGuard.Timestamp() = ts;
 }